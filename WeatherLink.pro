@@ -2,4 +2,7 @@ TEMPLATE = subdirs
 
 SUBDIRS += \
     WeatherLinkCollector \
-    WeatherLinkLauncher
+    WeatherLinkCollectorTest \
+    WeatherLinkLauncher \
+    WeatherLinkQuery \
+    WeatherLinkTrace
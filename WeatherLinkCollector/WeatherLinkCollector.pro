@@ -14,12 +14,17 @@ CONFIG   -= app_bundle
 
 TEMPLATE = app
 
+# Same library as the QSQLITE driver, whose handle is used directly
+LIBS += -lsqlite3
+
 
 SOURCES += main.cpp \
     weatherlinkcollector.cpp
 
 HEADERS += \
-    weatherlinkcollector.h
+    weatherlinkcollector.h \
+    weatherlinkschema.h \
+    weatherlinktrace.h
 
 target.path = /usr/bin
 INSTALLS += target
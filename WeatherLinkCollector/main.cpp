@@ -8,6 +8,8 @@ int main(int argc, char *argv[])
     QString name;
     QString url;
     QString path = "";
+    QString trace;
+    qint64 queued = 0;
     bool displayHelp = false;
 
     // Parse arguments
@@ -21,6 +23,10 @@ int main(int argc, char *argv[])
             displayHelp = true;
         } else if (((args[i] == "--path") || (args[i] == "-p")) && (args.count() > ++i)) {
             path = args[i];
+        } else if (((args[i] == "--trace") || (args[i] == "-t")) && (args.count() > ++i)) {
+            trace = args[i];
+        } else if (((args[i] == "--start") || (args[i] == "-s")) && (args.count() > ++i)) {
+            queued = args[i].toLongLong();
         }
     }
 
@@ -29,10 +35,12 @@ int main(int argc, char *argv[])
         QString help =
                 "WeatherLink Data Collector\n"
                 "Options:\n"
-                " -n --name: Name of meteo station\n"
-                " -u --url:  Url of meteo station\n"
-                " -p --path: Path to database\n"
-                " -h --help: Display current message\n";
+                " -n --name:  Name of meteo station\n"
+                " -u --url:   Url of meteo station\n"
+                " -p --path:  Path to database\n"
+                " -t --trace: Name of launcher trace server\n"
+                " -s --start: Time the station was queued in ms since epoch\n"
+                " -h --help:  Display current message\n";
 
         qDebug() << qPrintable(help);
         return 0;
@@ -40,6 +48,12 @@ int main(int argc, char *argv[])
 
     // Start collector
     WeatherLinkCollector collector(name, QUrl(url), path);
+    if (!trace.isEmpty()) {
+        collector.setTrace(trace);
+    }
+    if (queued > 0) {
+        collector.setQueued(queued);
+    }
     collector.start();
 
     return a.exec();
@@ -1,19 +1,47 @@
 #include "weatherlinkcollector.h"
+#include "weatherlinkschema.h"
+#include "weatherlinktrace.h"
 
 #include <QtNetwork/QNetworkRequest>
 #include <QtNetwork/QNetworkAccessManager>
+#include <QtNetwork/QLocalSocket>
 
 #include <QtSql/QSqlDatabase>
 #include <QtSql/QSqlError>
+#include <QtSql/QSqlDriver>
 #include <QtSql/QSqlQuery>
 #include <QtSql/QSqlTableModel>
 
+#include <QDateTime>
 #include <QDir>
 
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <sqlite3.h>
+
+// Rows of the summary found in the page
+enum WeatherLinkReading {
+    OutsideTemperatureReading = 0x001,
+    OutsideHumidityReading = 0x002,
+    InsideTemperatureReading = 0x004,
+    InsideHumidityReading = 0x008,
+    HeatIndexReading = 0x010,
+    WindChillReading = 0x020,
+    DewPointReading = 0x040,
+    PressureReading = 0x080,
+    WindSpeedReading = 0x100,
+    WindDirectionReading = 0x200,
+    AverageWindSpeedReading = 0x400,
+    WindGustReading = 0x800
+};
+
 class WeatherLinkData
 {
 public:
-    QDateTime timeStamp;
+    qint64 timeStamp;
 
     double currentOutsideTemperature;
     double maxOutsideTemperature;
@@ -53,7 +81,52 @@ public:
     double averageWindSpeed10Minutes;
     double windGust;
 
-    WeatherLinkData()
+    quint32 readings;
+    quint32 quality;
+
+    WeatherLinkData() :
+        timeStamp(0),
+
+        currentOutsideTemperature(0),
+        maxOutsideTemperature(0),
+        minOutsideTemperature(0),
+
+        currentOutsideHumidity(0),
+        maxOutsideHumidity(0),
+        minOutsideHumidity(0),
+
+        currentInsideTemperature(0),
+        maxInsideTemperature(0),
+        minInsideTemperature(0),
+
+        currentInsideHumidity(0),
+        maxInsideHumidity(0),
+        minInsideHumidity(0),
+
+        currentHeatIndex(0),
+        maxHeatIndex(0),
+
+        currentWindChill(0),
+        minWindChill(0),
+
+        currentDewPoint(0),
+        maxDewPoint(0),
+        minDewPoint(0),
+
+        currentPressure(0),
+        maxPressure(0),
+        minPressure(0),
+
+        currentWindSpeed(0),
+        maxWindSpeed(0),
+
+        currentWindDirection(0),
+        averageWindSpeed2Minutes(0),
+        averageWindSpeed10Minutes(0),
+        windGust(0),
+
+        readings(0),
+        quality(0)
     {}
 
     WeatherLinkData(const WeatherLinkData &other)
@@ -97,6 +170,9 @@ public:
         averageWindSpeed2Minutes = other.averageWindSpeed2Minutes;
         averageWindSpeed10Minutes = other.averageWindSpeed10Minutes;
         windGust = other.windGust;
+
+        readings = other.readings;
+        quality = other.quality;
     }
 
     bool operator ==(const WeatherLinkData &other)
@@ -184,10 +260,260 @@ public:
         averageWindSpeed10Minutes = other.averageWindSpeed10Minutes;
         windGust = other.windGust;
 
+        readings = other.readings;
+        quality = other.quality;
+
         return *this;
     }
 };
 
+// Smoothing factor of running statistics
+static const double alpha = 0.05;
+
+// Samples needed before spike detection kicks in
+static const quint32 warmup = 20;
+
+// Robust z-score above which a sample is a spike
+static const double spikeScore = 6;
+
+// Consecutive flagged samples after which a reading is considered to have really changed
+static const quint32 relearn = 10;
+
+// Running statistics of one reading, updated in O(1) per sample
+class WeatherLinkStatistics
+{
+public:
+    // A rate or resolution of 0 disables rate of change or spike checks
+    WeatherLinkStatistics(double minimumValue, double maximumValue, double maximumRate, double valueResolution) :
+        minimum(minimumValue),
+        maximum(maximumValue),
+        rate(maximumRate),
+        resolution(valueResolution),
+        count(0),
+        rejected(0),
+        lastTime(0),
+        last(0),
+        mean(0),
+        deviation(0)
+    {}
+
+    quint32 check(double value, qint64 time)
+    {
+        // Out of range values would only skew the statistics
+        if ((value < minimum) || (value > maximum)) {
+            return WeatherLinkSchema::RangeError;
+        }
+
+        quint32 flags = 0;
+
+        // Rate of change per minute against last accepted sample
+        if (count && (rate > 0) && (time > lastTime) && ((fabs(value - last) * 60 / (time - lastTime)) > rate)) {
+            flags |= WeatherLinkSchema::RateError;
+        }
+
+        // Robust z-score against exponentially weighted mean and mean absolute deviation,
+        // sqrt(pi / 2) scales the mean absolute deviation to a standard deviation
+        if ((resolution > 0) && (count >= warmup) &&
+                (fabs(value - mean) > (spikeScore * 1.2533 * qMax(deviation, resolution)))) {
+            flags |= WeatherLinkSchema::SpikeError;
+        }
+
+        // Flagged samples must not skew the statistics, unless they last
+        if (flags) {
+            if (++rejected < relearn) {
+                return flags;
+            }
+            count = 0;
+        }
+        rejected = 0;
+
+        // Learn from sample
+        if (!count) {
+            mean = value;
+        }
+        mean += alpha * (value - mean);
+        deviation += alpha * (fabs(value - mean) - deviation);
+        last = value;
+        lastTime = time;
+        count++;
+
+        return flags;
+    }
+
+private:
+    double minimum, maximum, rate, resolution;
+    quint32 count, rejected;
+    qint64 lastTime;
+    double last, mean, deviation;
+};
+
+// Quality control of samples between parsing and logging
+class WeatherLinkQuality
+{
+public:
+    WeatherLinkQuality() :
+        outsideTemperature(-60, 60, 2, 0.1),
+        outsideHumidity(0, 100, 10, 1),
+        insideTemperature(-20, 50, 2, 0.1),
+        pressure(870, 1085, 2, 0.1),
+        windSpeed(0, 400, 0, 1),
+        windDirection(0, 360, 0, 0),
+        dewPoint(-80, 40, 3, 0.1)
+    {}
+
+    quint32 check(const WeatherLinkData &data)
+    {
+        quint32 flags = 0;
+
+        // Readings missing from the page are not checked
+        if (data.readings & OutsideTemperatureReading) {
+            flags |= outsideTemperature.check(data.currentOutsideTemperature, data.timeStamp) << WeatherLinkSchema::OutsideTemperatureQuality;
+        }
+        if (data.readings & OutsideHumidityReading) {
+            flags |= outsideHumidity.check(data.currentOutsideHumidity, data.timeStamp) << WeatherLinkSchema::OutsideHumidityQuality;
+        }
+        if (data.readings & InsideTemperatureReading) {
+            flags |= insideTemperature.check(data.currentInsideTemperature, data.timeStamp) << WeatherLinkSchema::InsideTemperatureQuality;
+        }
+        if (data.readings & PressureReading) {
+            flags |= pressure.check(data.currentPressure, data.timeStamp) << WeatherLinkSchema::PressureQuality;
+        }
+        if (data.readings & WindSpeedReading) {
+            flags |= windSpeed.check(data.currentWindSpeed, data.timeStamp) << WeatherLinkSchema::WindSpeedQuality;
+        }
+        if (data.readings & WindDirectionReading) {
+            flags |= windDirection.check(data.currentWindDirection, data.timeStamp) << WeatherLinkSchema::WindDirectionQuality;
+        }
+        if (data.readings & DewPointReading) {
+            flags |= dewPoint.check(data.currentDewPoint, data.timeStamp) << WeatherLinkSchema::DewPointQuality;
+        }
+
+        return flags;
+    }
+
+private:
+    WeatherLinkStatistics outsideTemperature;
+    WeatherLinkStatistics outsideHumidity;
+    WeatherLinkStatistics insideTemperature;
+    WeatherLinkStatistics pressure;
+    WeatherLinkStatistics windSpeed;
+    WeatherLinkStatistics windDirection;
+    WeatherLinkStatistics dewPoint;
+};
+
+// Text of a table cell, pointing into the page content
+class WeatherLinkCell
+{
+public:
+    const char *text;
+    int length;
+
+    WeatherLinkCell() :
+        text(0),
+        length(0)
+    {}
+
+    bool operator ==(const char *label) const
+    {
+        return (length == int(qstrlen(label))) && !qstrncmp(text, label, length);
+    }
+};
+
+// Find needle in [from, end), returns end when not found
+static const char *find(const char *from, const char *end, const char *needle)
+{
+    int length = qstrlen(needle);
+    for (; (end - from) >= length; from++) {
+        if (!memcmp(from, needle, length)) {
+            return from;
+        }
+    }
+    return end;
+}
+
+// Extract next table cell from [pos, end) and move pos after it
+static bool nextCell(const char *&pos, const char *end, WeatherLinkCell &cell)
+{
+    const char *open = find(pos, end, "<td");
+    const char *text = find(open, end, ">");
+    if (text == end) {
+        return false;
+    }
+    text++;
+
+    const char *close = find(text, end, "</td>");
+    if (close == end) {
+        return false;
+    }
+
+    cell.text = text;
+    cell.length = close - text;
+    pos = close + 5;
+    return true;
+}
+
+// Numeric value of a cell such as "-3.5 C" or "NNW&nbsp;337&deg;", 0 if there is none
+// Number at the start of a cell, ok is false if the cell holds none such as "---"
+static double cellValue(const WeatherLinkCell &cell, bool *ok = 0)
+{
+    const char *c = cell.text, *end = cell.text + cell.length;
+
+    // Skip wind direction prefix
+    const char *direction = c;
+    while ((direction < end) && *direction && strchr("NSEW", *direction)) {
+        direction++;
+    }
+    if ((direction != c) && ((end - direction) >= 6) && !memcmp(direction, "&nbsp;", 6)) {
+        c = direction + 6;
+    }
+
+    bool negative = false;
+    if ((c < end) && (*c == '-')) {
+        negative = true;
+        c++;
+    }
+
+    const char *digits = c;
+    double value = 0;
+    while ((c < end) && (*c >= '0') && (*c <= '9')) {
+        value = (value * 10) + (*c++ - '0');
+    }
+    if ((c < end) && (*c == '.')) {
+        double scale = 0.1;
+        for (c++; (c < end) && (*c >= '0') && (*c <= '9'); c++, scale /= 10) {
+            value += (*c - '0') * scale;
+        }
+    }
+
+    if (ok) {
+        *ok = (c != digits) && !((c - digits == 1) && (*digits == '.'));
+    }
+
+    return negative ? -value : value;
+}
+
+// Bind a reading, NULL if it was not found in the page
+static void bindDouble(sqlite3_stmt *statement, int index, double value, bool found)
+{
+    if (found) {
+        sqlite3_bind_double(statement, index, value);
+    } else {
+        sqlite3_bind_null(statement, index);
+    }
+}
+
+static void bindInt(sqlite3_stmt *statement, int index, int value, bool found)
+{
+    if (found) {
+        sqlite3_bind_int(statement, index, value);
+    } else {
+        sqlite3_bind_null(statement, index);
+    }
+}
+
+// Polls skipped while a fetch is pending before giving up on it
+static const quint32 stalledPolls = 3;
+
 class WeatherLinkCollectorPrivate
 {
 public:
@@ -197,8 +523,19 @@ public:
         path(where),
         interval(intervalSeconds),
         depth(depthSeconds),
-        db(QSqlDatabase::addDatabase("QSQLITE"))
+        db(QSqlDatabase::addDatabase("QSQLITE")),
+        tableReady(false),
+        firstSample(true),
+        sqlite(0),
+        insertStatement(0),
+        purgeStatement(0),
+        reply(0),
+        skipped(0),
+        tracing(false)
     {
+        // Measure time to first sample, unless the launcher tells when the station was queued
+        queued = QDateTime::currentMSecsSinceEpoch();
+
         // Compute path if not provided
         if (path.isEmpty()) {
             path = QString(QDir::home().path());
@@ -209,27 +546,67 @@ public:
         // Set database name
         db.setDatabaseName(path);
 
+        // Wait for the lock instead of failing when many collectors start at once
+        db.setConnectOptions("QSQLITE_BUSY_TIMEOUT=10000");
+
         // Open database
         if (!db.open()) {
             qDebug() << qPrintable(db.lastError().text());
         }
+
+        // Buffers reused by every poll
+        request.setUrl(location);
+        content.reserve(64 * 1024);
+        events.reserve(1024);
     }
 
     ~WeatherLinkCollectorPrivate()
     {
+        // Connection cannot be closed with statements still open
+        sqlite3_finalize(insertStatement);
+        sqlite3_finalize(purgeStatement);
         db.close();
     }
 
+    void trace(quint8 kind, quint8 category, quint32 value = 0)
+    {
+        if (tracing) {
+            WeatherLinkTrace::append(events, WeatherLinkTrace::Event(kind, category, value, WeatherLinkTrace::now()));
+        }
+    }
+
+    void flush()
+    {
+        // One write per poll cycle
+        if (tracing && !events.isEmpty()) {
+            traceSocket.write(events);
+            events.resize(0);
+        }
+    }
+
     int timerId;
     QString name;
     QUrl location;
     QString path;
     quint32 interval, depth;
     QSqlDatabase db;
+    bool tableReady;
+    bool firstSample;
+    qint64 queued;
+    sqlite3 *sqlite;
+    sqlite3_stmt *insertStatement, *purgeStatement;
 
     QNetworkAccessManager manager;
+    QNetworkRequest request;
+    QNetworkReply *reply;
+    quint32 skipped;
     QByteArray content;
+    WeatherLinkQuality quality;
     WeatherLinkData lastData;
+
+    bool tracing;
+    QLocalSocket traceSocket;
+    QByteArray events;
 };
 
 
@@ -238,6 +615,9 @@ WeatherLinkCollector::WeatherLinkCollector(const QString &name, const QUrl &loca
     QObject(parent),
     d(new WeatherLinkCollectorPrivate(name, location, path, interval, depth))
 {
+    // Connected once, a per reply connection would be allocated every poll
+    connect(&d->manager, SIGNAL(finished(QNetworkReply*)),
+            this, SLOT(finished(QNetworkReply*)));
 }
 
 WeatherLinkCollector::~WeatherLinkCollector()
@@ -246,10 +626,34 @@ WeatherLinkCollector::~WeatherLinkCollector()
 }
 
 
+void WeatherLinkCollector::setTrace(const QString &server)
+{
+    // Connect to the trace server of the launcher
+    d->traceSocket.connectToServer(server, QIODevice::WriteOnly);
+    if (!d->traceSocket.waitForConnected(1000)) {
+        qDebug() << "Trace error:" << qPrintable(d->traceSocket.errorString());
+        return;
+    }
+
+    // Introduce station
+    d->tracing = true;
+    WeatherLinkTrace::appendStation(d->events, 0, d->name);
+    d->flush();
+}
+
+void WeatherLinkCollector::setQueued(qint64 msecsSinceEpoch)
+{
+    // Time to first sample then includes the launch wave and process start
+    d->queued = msecsSinceEpoch;
+}
+
 void WeatherLinkCollector::start()
 {
     // Start timer
     d->timerId = startTimer(d->interval * 1000);
+
+    // First capture right away instead of after a full interval
+    dump();
 }
 
 
@@ -263,225 +667,319 @@ void WeatherLinkCollector::timerEvent(QTimerEvent *e)
 
 void WeatherLinkCollector::dump()
 {
+    // One fetch at a time, a slow station must not pile up requests
+    if (d->reply) {
+        if (++d->skipped <= stalledPolls) {
+            d->trace(WeatherLinkTrace::Instant, WeatherLinkTrace::Skip, d->skipped);
+            d->flush();
+            return;
+        }
+
+        // No timeout in the network manager, finished() is called right away
+        qDebug() << "Fetch of" << qPrintable(d->name) << "stalled, abort";
+        d->reply->abort();
+    }
+
     // Get page content
-    QNetworkRequest request(d->location);
-    QNetworkReply *reply = d->manager.get(request);
-    connect(reply, SIGNAL(finished()),
-            this, SLOT(finished()));
+    d->trace(WeatherLinkTrace::Begin, WeatherLinkTrace::Fetch);
+    d->reply = d->manager.get(d->request);
 }
 
-void WeatherLinkCollector::parse()
+bool WeatherLinkCollector::parse()
 {
+    static const char start[] = "<!-- START: SUMMARY WEATHER DISPLAY -->";
+    static const char end[] = "<!-- END: SUMMARY WEATHER DISPLAY -->";
+
+    d->trace(WeatherLinkTrace::Begin, WeatherLinkTrace::Parse);
+
     WeatherLinkData data;
 
     // Save current time stamp
-    data.timeStamp = QDateTime::currentDateTime();
-
-    qDebug() << "Capture at:" << qPrintable(data.timeStamp.toString(Qt::ISODate));
+    data.timeStamp = QDateTime::currentMSecsSinceEpoch() / 1000;
+
+    char timeString[32];
+    time_t t = data.timeStamp;
+    struct tm local;
+    strftime(timeString, sizeof(timeString), "%Y-%m-%dT%H:%M:%S", localtime_r(&t, &local));
+    fprintf(stderr, "Capture at: %s\n", timeString);
+
+    // Re format content in place
+    char *content = d->content.data();
+    int length = 0;
+    for (int i = 0; i < d->content.size(); i++) {
+        if (content[i] == '\t') {
+            continue;
+        }
+        if ((content[i] == '\r') && ((i + 1) < d->content.size()) && (content[i + 1] == '\n')) {
+            i++;
+            continue;
+        }
+        content[length++] = content[i];
+    }
+    d->content.resize(length);
 
-    // Re format content
-    d->content.replace("\r\n", "");
-    d->content.replace("\t", "");
-    QString start = "<!-- START: SUMMARY WEATHER DISPLAY -->", end = "<!-- END: SUMMARY WEATHER DISPLAY -->";
     int startIndex = d->content.indexOf(start), endIndex = d->content.indexOf(end);
-    d->content = d->content.mid(startIndex + start.length(), (endIndex - startIndex - start.length()));
-
-    // Extract data
-    QRegExp regex("<td width=\"\\d+\" class=\"\\w+\">([A-Za-z\\s]+)</td>" \
-                  "<td width=\"\\d+\" class=\"\\w+\">(([NSEW]+&nbsp;)?(-?\\d+\\.?\\d?)\\s?(C|%|mb|km/h|&deg;)|&nbsp;)</td>" \
-                  "<td width=\"\\d+\" class=\"\\w+\">((-?\\d+\\.?\\d?)\\s?(C|%|mb|km/h)|&nbsp;)</td>" \
-                  "<td width=\"\\d+\" class=\"\\w+\">(\\d\\d:\\d\\d|&nbsp;)</td>" \
-                  "<td width=\"\\d+\" class=\"\\w+\">((-?\\d+\\.?\\d?)\\s?(C|%|mb|km/h)|&nbsp;)</td>" \
-                  "<td width=\"\\d+\" class=\"\\w+\">(\\d\\d:\\d\\d|&nbsp;)</td>");
-    int pos = 0;
-
-    regex.indexIn(d->content);
-    while ((pos = regex.indexIn(d->content, pos)) != -1) {
-        pos += regex.matchedLength();
-
-        QStringList captures = regex.capturedTexts();
-
-        if (regex.captureCount() == 13) {
-            if (captures[1] == "Outside Temp") {
-                data.currentOutsideTemperature = captures[4].toDouble();
-                data.maxOutsideTemperature = captures[7].toDouble();
-                data.minOutsideTemperature = captures[11].toDouble();
-            } else if (captures[1] == "Outside Humidity") {
-                data.currentOutsideHumidity = captures[4].toUShort();
-                data.maxOutsideHumidity = captures[7].toUShort();
-                data.minOutsideHumidity = captures[11].toUShort();
-            } else if (captures[1] == "Inside Temp") {
-                data.currentInsideTemperature = captures[4].toDouble();
-                data.maxInsideTemperature = captures[7].toDouble();
-                data.minInsideTemperature = captures[11].toDouble();
-            } else if (captures[1] == "Inside Humidity") {
-                data.currentInsideHumidity = captures[4].toUShort();
-                data.maxInsideHumidity = captures[7].toUShort();
-                data.minInsideHumidity = captures[11].toUShort();
-            } else if (captures[1] == "Heat Index") {
-                data.currentHeatIndex = captures[4].toDouble();
-                data.maxHeatIndex = captures[7].toDouble();
-            } else if (captures[1] == "Wind Chill") {
-                data.currentWindChill = captures[4].toDouble();
-                data.minWindChill = captures[11].toDouble();
-            } else if (captures[1] == "Dew Point") {
-                data.currentDewPoint = captures[4].toDouble();
-                data.maxDewPoint = captures[7].toDouble();
-                data.minDewPoint = captures[11].toDouble();
-            } else if (captures[1] == "Barometer") {
-                data.currentPressure = captures[4].toDouble();
-                data.maxPressure = captures[7].toDouble();
-                data.minPressure = captures[11].toDouble();
-            } else if (captures[1] == "Bar Trend") {
-            } else if (captures[1] == "Wind Speed") {
-                data.currentWindSpeed = captures[4].toDouble();
-                data.maxWindSpeed = captures[7].toDouble();
-            } else if (captures[1] == "Wind Direction") {
-                data.currentWindDirection = captures[4].toUShort();
-                if (data.currentWindDirection > 360) {
-                    qDebug() << "Error on wind direction:" << qPrintable(captures[0]);
-                }
-            } else if (captures[1] == "Solar Radiation") {
-            } else if (captures[1] == "UV Radiation") {
-            } else if (captures[1] == "Average Wind Speed") {
-                data.averageWindSpeed2Minutes = captures[4].toDouble();
-                data.averageWindSpeed10Minutes = captures[7].toDouble();
-            } else if (captures[1] == "Wind Gust Speed") {
-                data.windGust = captures[7].toDouble();
-            }
+    if ((startIndex == -1) || (endIndex < startIndex)) {
+        fprintf(stderr, "Summary not found in page\n");
+        d->trace(WeatherLinkTrace::End, WeatherLinkTrace::Parse);
+        return false;
+    }
+
+    // Extract data, each row is a label followed by five cells
+    const char *pos = content + startIndex + sizeof(start) - 1, *last = content + endIndex;
+    WeatherLinkCell cells[6];
+    quint32 rows = 0;
+
+    while (nextCell(pos, last, cells[0])) {
+        WeatherLinkCell &label = cells[0];
+
+        // Only rows starting with a known label are of interest
+        if (!(label == "Outside Temp") && !(label == "Outside Humidity") &&
+                !(label == "Inside Temp") && !(label == "Inside Humidity") &&
+                !(label == "Heat Index") && !(label == "Wind Chill") &&
+                !(label == "Dew Point") && !(label == "Barometer") &&
+                !(label == "Bar Trend") && !(label == "Wind Speed") &&
+                !(label == "Wind Direction") && !(label == "Solar Radiation") &&
+                !(label == "UV Radiation") && !(label == "Average Wind Speed") &&
+                !(label == "Wind Gust Speed")) {
+            continue;
+        }
+
+        bool complete = true;
+        for (int i = 1; (i < 6) && complete; i++) {
+            complete = nextCell(pos, last, cells[i]);
         }
+        if (!complete) {
+            break;
+        }
+        rows++;
+
+        bool currentFound, highFound;
+        double current = cellValue(cells[1], &currentFound), high = cellValue(cells[2], &highFound), low = cellValue(cells[4]);
+
+        // Readings are only present when their current value is, a dead sensor shows "---"
+        quint32 reading = 0;
+        bool found = currentFound;
+
+        if (label == "Outside Temp") {
+            reading = OutsideTemperatureReading;
+            data.currentOutsideTemperature = current;
+            data.maxOutsideTemperature = high;
+            data.minOutsideTemperature = low;
+        } else if (label == "Outside Humidity") {
+            reading = OutsideHumidityReading;
+            data.currentOutsideHumidity = quint16(current);
+            data.maxOutsideHumidity = quint16(high);
+            data.minOutsideHumidity = quint16(low);
+        } else if (label == "Inside Temp") {
+            reading = InsideTemperatureReading;
+            data.currentInsideTemperature = current;
+            data.maxInsideTemperature = high;
+            data.minInsideTemperature = low;
+        } else if (label == "Inside Humidity") {
+            reading = InsideHumidityReading;
+            data.currentInsideHumidity = quint16(current);
+            data.maxInsideHumidity = quint16(high);
+            data.minInsideHumidity = quint16(low);
+        } else if (label == "Heat Index") {
+            reading = HeatIndexReading;
+            data.currentHeatIndex = current;
+            data.maxHeatIndex = high;
+        } else if (label == "Wind Chill") {
+            reading = WindChillReading;
+            data.currentWindChill = current;
+            data.minWindChill = low;
+        } else if (label == "Dew Point") {
+            reading = DewPointReading;
+            data.currentDewPoint = current;
+            data.maxDewPoint = high;
+            data.minDewPoint = low;
+        } else if (label == "Barometer") {
+            reading = PressureReading;
+            data.currentPressure = current;
+            data.maxPressure = high;
+            data.minPressure = low;
+        } else if (label == "Bar Trend") {
+        } else if (label == "Wind Speed") {
+            reading = WindSpeedReading;
+            data.currentWindSpeed = current;
+            data.maxWindSpeed = high;
+        } else if (label == "Wind Direction") {
+            reading = WindDirectionReading;
+            data.currentWindDirection = quint16(current);
+        } else if (label == "Solar Radiation") {
+        } else if (label == "UV Radiation") {
+        } else if (label == "Average Wind Speed") {
+            reading = AverageWindSpeedReading;
+            data.averageWindSpeed2Minutes = current;
+            data.averageWindSpeed10Minutes = high;
+        } else if (label == "Wind Gust Speed") {
+            reading = WindGustReading;
+            found = highFound;
+            data.windGust = high;
+        }
+        if (found) {
+            data.readings |= reading;
+        }
+    }
+
+    d->trace(WeatherLinkTrace::End, WeatherLinkTrace::Parse, rows);
+
+    // Flag suspicious readings
+    d->trace(WeatherLinkTrace::Begin, WeatherLinkTrace::Quality);
+    data.quality = d->quality.check(data);
+    d->trace(WeatherLinkTrace::End, WeatherLinkTrace::Quality, data.quality);
+    if (data.quality) {
+        fprintf(stderr, "Quality flags: 0x%x\n", data.quality);
     }
 
     // Save data
     d->lastData = data;
 
-    // Log
-    log();
+    return true;
 }
 
 void WeatherLinkCollector::log()
 {
-    QSqlQuery sqlQuery(d->db);
-
-    // Test if the requested table exists
-    if (!d->db.tables().contains(d->name, Qt::CaseInsensitive)) {
-        qDebug() << "Create table:" << qPrintable(d->name);
-
-        // Create table
-        if (!sqlQuery.exec(QString("create table %1"
-                                   "(id integer primary key,"
-
-                                   "timeStamp datetime,"
-                                   "currentOutsideTemperature double,"
-                                   "maxOutsideTemperature double,"
-                                   "minOutsideTemperature double,"
-
-                                   "currentOutsideHumidity integer,"
-                                   "maxOutsideHumidity integer,"
-                                   "minOutsideHumidity integer,"
-
-                                   "currentInsideTemperature double,"
-                                   "maxInsideTemperature double,"
-                                   "minInsideTemperature double,"
-
-                                   "currentInsideHumidity integer,"
-                                   "maxInsideHumidity integer,"
-                                   "minInsideHumidity integer,"
-
-                                   "currentHeatIndex double,"
-                                   "maxHeatIndex double,"
-
-                                   "currentWindChill double,"
-                                   "minWindChill double,"
-
-                                   "currentDewPoint double,"
-                                   "maxDewPoint double,"
-                                   "minDewPoint double,"
-
-                                   "currentPressure double,"
-                                   "maxPressure double,"
-                                   "minPressure double,"
-
-                                   "currentWindSpeed double,"
-                                   "maxWindSpeed double,"
-
-                                   "currentWindDirection integer,"
-                                   "averageWindSpeed2Minutes double,"
-                                   "averageWindSpeed10Minutes double,"
-                                   "windGust double)").arg(d->name))) {
-            qDebug() << qPrintable(sqlQuery.lastError().text());
+    // Create table once, the launcher normally did it already
+    if (!d->tableReady) {
+        if (!WeatherLinkSchema::createStation(d->db, d->name)) {
+            return;
         }
-    }
-
-    // Insert data into table
-    if (!sqlQuery.exec(QString("insert into %1 values(NULL, %2, %3, %4, %5, %6, %7, %8, %9, %10, %11, %12, %13, %14, %15, %16, %17, %18, %19, %20, %21, %22, %23, %24, %25, %26, %27, %28, %29, %30)")
-                       .arg(d->name)
-
-                       .arg(d->lastData.timeStamp.toMSecsSinceEpoch() / 1000)
-                       .arg(d->lastData.currentOutsideTemperature)
-                       .arg(d->lastData.maxOutsideTemperature)
-                       .arg(d->lastData.minOutsideTemperature)
-
-                       .arg(d->lastData.currentOutsideHumidity)
-                       .arg(d->lastData.maxOutsideHumidity)
-                       .arg(d->lastData.minOutsideHumidity)
-
-                       .arg(d->lastData.currentInsideTemperature)
-                       .arg(d->lastData.maxInsideTemperature)
-                       .arg(d->lastData.minInsideTemperature)
 
-                       .arg(d->lastData.currentInsideHumidity)
-                       .arg(d->lastData.maxInsideHumidity)
-                       .arg(d->lastData.minInsideHumidity)
-
-                       .arg(d->lastData.currentHeatIndex)
-                       .arg(d->lastData.maxHeatIndex)
-
-                       .arg(d->lastData.currentWindChill)
-                       .arg(d->lastData.minWindChill)
-
-                       .arg(d->lastData.currentDewPoint)
-                       .arg(d->lastData.maxDewPoint)
-                       .arg(d->lastData.minDewPoint)
-
-                       .arg(d->lastData.currentPressure)
-                       .arg(d->lastData.maxPressure)
-                       .arg(d->lastData.minPressure)
+        // Statements are bound straight through SQLite, QSqlQuery allocates on every bind and exec
+        QVariant handle = d->db.driver()->handle();
+        if (!handle.isValid() || (qstrcmp(handle.typeName(), "sqlite3*") != 0)) {
+            qDebug() << "No SQLite handle for" << qPrintable(d->name);
+            return;
+        }
+        d->sqlite = *static_cast<sqlite3 **>(handle.data());
+
+        // Prepare statements reused by every poll
+        QByteArray insert = QString("insert into %1 values(NULL, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)")
+                .arg(d->name).toUtf8();
+        QByteArray purge = QString("delete from %1 where timeStamp < ?").arg(d->name).toUtf8();
+        if ((sqlite3_prepare_v2(d->sqlite, insert.constData(), -1, &d->insertStatement, 0) != SQLITE_OK) ||
+                (sqlite3_prepare_v2(d->sqlite, purge.constData(), -1, &d->purgeStatement, 0) != SQLITE_OK)) {
+            qDebug() << sqlite3_errmsg(d->sqlite);
+            sqlite3_finalize(d->insertStatement);
+            sqlite3_finalize(d->purgeStatement);
+            d->insertStatement = 0;
+            d->purgeStatement = 0;
+            return;
+        }
 
-                       .arg(d->lastData.currentWindSpeed)
-                       .arg(d->lastData.maxWindSpeed)
+        d->tableReady = true;
+    }
 
-                       .arg(d->lastData.currentWindDirection)
-                       .arg(d->lastData.averageWindSpeed2Minutes)
-                       .arg(d->lastData.averageWindSpeed10Minutes)
-                       .arg(d->lastData.windGust))) {
-        qDebug() << qPrintable(sqlQuery.lastError().text());
+    // Insert data into table, readings missing from the page are stored as NULL
+    const WeatherLinkData &data = d->lastData;
+    sqlite3_stmt *insert = d->insertStatement;
+    int i = 1;
+    sqlite3_bind_int64(insert, i++, data.timeStamp);
+
+    bool found = data.readings & OutsideTemperatureReading;
+    bindDouble(insert, i++, data.currentOutsideTemperature, found);
+    bindDouble(insert, i++, data.maxOutsideTemperature, found);
+    bindDouble(insert, i++, data.minOutsideTemperature, found);
+
+    found = data.readings & OutsideHumidityReading;
+    bindInt(insert, i++, data.currentOutsideHumidity, found);
+    bindInt(insert, i++, data.maxOutsideHumidity, found);
+    bindInt(insert, i++, data.minOutsideHumidity, found);
+
+    found = data.readings & InsideTemperatureReading;
+    bindDouble(insert, i++, data.currentInsideTemperature, found);
+    bindDouble(insert, i++, data.maxInsideTemperature, found);
+    bindDouble(insert, i++, data.minInsideTemperature, found);
+
+    found = data.readings & InsideHumidityReading;
+    bindInt(insert, i++, data.currentInsideHumidity, found);
+    bindInt(insert, i++, data.maxInsideHumidity, found);
+    bindInt(insert, i++, data.minInsideHumidity, found);
+
+    found = data.readings & HeatIndexReading;
+    bindDouble(insert, i++, data.currentHeatIndex, found);
+    bindDouble(insert, i++, data.maxHeatIndex, found);
+
+    found = data.readings & WindChillReading;
+    bindDouble(insert, i++, data.currentWindChill, found);
+    bindDouble(insert, i++, data.minWindChill, found);
+
+    found = data.readings & DewPointReading;
+    bindDouble(insert, i++, data.currentDewPoint, found);
+    bindDouble(insert, i++, data.maxDewPoint, found);
+    bindDouble(insert, i++, data.minDewPoint, found);
+
+    found = data.readings & PressureReading;
+    bindDouble(insert, i++, data.currentPressure, found);
+    bindDouble(insert, i++, data.maxPressure, found);
+    bindDouble(insert, i++, data.minPressure, found);
+
+    found = data.readings & WindSpeedReading;
+    bindDouble(insert, i++, data.currentWindSpeed, found);
+    bindDouble(insert, i++, data.maxWindSpeed, found);
+
+    bindInt(insert, i++, data.currentWindDirection, data.readings & WindDirectionReading);
+    found = data.readings & AverageWindSpeedReading;
+    bindDouble(insert, i++, data.averageWindSpeed2Minutes, found);
+    bindDouble(insert, i++, data.averageWindSpeed10Minutes, found);
+    bindDouble(insert, i++, data.windGust, data.readings & WindGustReading);
+
+    sqlite3_bind_int64(insert, i++, data.quality);
+
+    if (sqlite3_step(insert) != SQLITE_DONE) {
+        qDebug() << sqlite3_errmsg(d->sqlite);
+    } else if (d->firstSample) {
+        qDebug() << "First sample of" << qPrintable(d->name) << "after:" << (QDateTime::currentMSecsSinceEpoch() - d->queued) << "ms";
+        d->firstSample = false;
     }
+    sqlite3_reset(insert);
 
     // Clean all out dated records
-    if (!sqlQuery.exec(QString("delete from %1 where timeStamp < %2")
-                      .arg(d->name)
-                      .arg((d->lastData.timeStamp.toMSecsSinceEpoch() / 1000) - d->depth))) {
-        QSqlError error = sqlQuery.lastError();
-        if (error.type() != QSqlError::NoError)
-            qDebug() << qPrintable(error.text());
+    sqlite3_bind_int64(d->purgeStatement, 1, data.timeStamp - d->depth);
+    if (sqlite3_step(d->purgeStatement) != SQLITE_DONE) {
+        qDebug() << sqlite3_errmsg(d->sqlite);
     }
+    sqlite3_reset(d->purgeStatement);
 }
 
 
-void WeatherLinkCollector::finished()
+void WeatherLinkCollector::receive(QIODevice *device)
 {
-    // Get associated network reply
-    QNetworkReply *reply = qobject_cast<QNetworkReply *>(sender());
+    // Extract page content into the reused buffer
+    qint64 size = device->bytesAvailable();
+    d->content.resize(int(size));
+    d->content.resize(int(device->read(d->content.data(), size)));
+}
 
-    // Extract page content
-    d->content = reply->readAll();
+void WeatherLinkCollector::finished(QNetworkReply *reply)
+{
+    d->reply = 0;
+    d->skipped = 0;
 
     // Prepare deletion of network reply
     reply->deleteLater();
 
-    // Parse page
-    parse();
+    if (reply->error() != QNetworkReply::NoError) {
+        qDebug() << "Network error:" << qPrintable(reply->errorString());
+        d->trace(WeatherLinkTrace::End, WeatherLinkTrace::Fetch, 0);
+        d->flush();
+        return;
+    }
+
+    receive(reply);
+    d->trace(WeatherLinkTrace::End, WeatherLinkTrace::Fetch, d->content.size());
+
+    // Parse page and log
+    if (parse()) {
+        d->trace(WeatherLinkTrace::Begin, WeatherLinkTrace::Store);
+        log();
+        d->trace(WeatherLinkTrace::End, WeatherLinkTrace::Store);
+    }
+
+    // Send trace of the cycle
+    d->flush();
 }
 
 void WeatherLinkCollector::error(QNetworkReply::NetworkError)
@@ -14,16 +14,21 @@ public:
     WeatherLinkCollector(const QString &name, const QUrl &location, const QString &path = "", quint32 interval = 30, quint32 depth = 7200, QObject *parent = 0);
     ~WeatherLinkCollector();
 
+    void setTrace(const QString &server);
+    void setQueued(qint64 msecsSinceEpoch);
     void start();
 
+protected:
+    void receive(QIODevice *device);
+
 protected slots:
     void timerEvent(QTimerEvent *e);
     void dump();
-    void parse();
+    bool parse();
     void log();
 
 private slots:
-    void finished();
+    void finished(QNetworkReply *reply);
     void error(QNetworkReply::NetworkError code);
 
 private:
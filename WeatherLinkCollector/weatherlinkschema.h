@@ -0,0 +1,162 @@
+#ifndef WEATHERLINKSCHEMA_H
+#define WEATHERLINKSCHEMA_H
+
+#include <QString>
+#include <QStringList>
+#include <QDebug>
+
+#include <QtSql/QSqlDatabase>
+#include <QtSql/QSqlError>
+#include <QtSql/QSqlQuery>
+#include <QtSql/QSqlRecord>
+
+namespace WeatherLinkSchema
+{
+
+// Quality checks, shifted by the reading they apply to in the quality column
+enum QualityCheck {
+    RangeError = 0x1,
+    RateError = 0x2,
+    SpikeError = 0x4
+};
+
+enum QualityField {
+    OutsideTemperatureQuality = 0,
+    OutsideHumidityQuality = 3,
+    InsideTemperatureQuality = 6,
+    PressureQuality = 9,
+    WindSpeedQuality = 12,
+    WindDirectionQuality = 15,
+    DewPointQuality = 18
+};
+
+// Bits of a quality field
+static const quint32 qualityMask = 0x7;
+
+// Shift of the quality flags of a column, -1 for columns that are not checked
+inline int qualityField(const QString &column)
+{
+    if (column == "currentOutsideTemperature") {
+        return OutsideTemperatureQuality;
+    } else if (column == "currentOutsideHumidity") {
+        return OutsideHumidityQuality;
+    } else if (column == "currentInsideTemperature") {
+        return InsideTemperatureQuality;
+    } else if (column == "currentPressure") {
+        return PressureQuality;
+    } else if (column == "currentWindSpeed") {
+        return WindSpeedQuality;
+    } else if (column == "currentWindDirection") {
+        return WindDirectionQuality;
+    } else if (column == "currentDewPoint") {
+        return DewPointQuality;
+    }
+    return -1;
+}
+
+// Statement creating the table of a station, no-op if it already exists
+inline QString createTable(const QString &name)
+{
+    return QString("create table if not exists %1"
+                   "(id integer primary key,"
+
+                   "timeStamp datetime,"
+                   "currentOutsideTemperature double,"
+                   "maxOutsideTemperature double,"
+                   "minOutsideTemperature double,"
+
+                   "currentOutsideHumidity integer,"
+                   "maxOutsideHumidity integer,"
+                   "minOutsideHumidity integer,"
+
+                   "currentInsideTemperature double,"
+                   "maxInsideTemperature double,"
+                   "minInsideTemperature double,"
+
+                   "currentInsideHumidity integer,"
+                   "maxInsideHumidity integer,"
+                   "minInsideHumidity integer,"
+
+                   "currentHeatIndex double,"
+                   "maxHeatIndex double,"
+
+                   "currentWindChill double,"
+                   "minWindChill double,"
+
+                   "currentDewPoint double,"
+                   "maxDewPoint double,"
+                   "minDewPoint double,"
+
+                   "currentPressure double,"
+                   "maxPressure double,"
+                   "minPressure double,"
+
+                   "currentWindSpeed double,"
+                   "maxWindSpeed double,"
+
+                   "currentWindDirection integer,"
+                   "averageWindSpeed2Minutes double,"
+                   "averageWindSpeed10Minutes double,"
+                   "windGust double,"
+
+                   "quality integer default 0)").arg(name);
+}
+
+// Statement indexing the table of a station on time stamps
+inline QString createIndex(const QString &name)
+{
+    return QString("create index if not exists %1_timeStamp on %1(timeStamp)").arg(name);
+}
+
+// Create or upgrade the table of a station
+inline bool createStation(QSqlDatabase &db, const QString &name)
+{
+    QSqlQuery sqlQuery(db);
+    if (!sqlQuery.exec(createTable(name)) || !sqlQuery.exec(createIndex(name))) {
+        qDebug() << qPrintable(sqlQuery.lastError().text());
+        return false;
+    }
+
+    // Tables created before quality flags were introduced
+    if (!db.record(name).contains("quality") &&
+            !sqlQuery.exec(QString("alter table %1 add column quality integer default 0").arg(name))) {
+        qDebug() << qPrintable(sqlQuery.lastError().text());
+        return false;
+    }
+
+    return true;
+}
+
+// Create the tables of all stations in a single transaction
+inline bool migrate(QSqlDatabase &db, const QStringList &names)
+{
+    // Readers such as wl_query must not block collector commits, which they do with a rollback journal
+    QSqlQuery sqlQuery(db);
+    if (!sqlQuery.exec("pragma journal_mode=wal")) {
+        qDebug() << qPrintable(sqlQuery.lastError().text());
+    }
+    sqlQuery.finish();
+
+    if (!db.transaction()) {
+        qDebug() << qPrintable(db.lastError().text());
+        return false;
+    }
+
+    foreach (const QString &name, names) {
+        if (!createStation(db, name)) {
+            db.rollback();
+            return false;
+        }
+    }
+
+    if (!db.commit()) {
+        qDebug() << qPrintable(db.lastError().text());
+        return false;
+    }
+
+    return true;
+}
+
+}
+
+#endif // WEATHERLINKSCHEMA_H
@@ -0,0 +1,129 @@
+#ifndef WEATHERLINKTRACE_H
+#define WEATHERLINKTRACE_H
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QtEndian>
+
+#ifdef Q_OS_UNIX
+#include <time.h>
+#endif
+
+namespace WeatherLinkTrace
+{
+
+// File header, followed by records
+static const char magic[4] = { 'W', 'L', 'T', 'R' };
+static const quint32 version = 1;
+static const int headerSize = 8;
+
+enum Kind {
+    Station = 0,    // Names a station, followed by value bytes of UTF-8 name
+    Begin = 1,      // Start of a span
+    End = 2,        // End of a span
+    Instant = 3     // Single event
+};
+
+enum Category {
+    Fetch = 0,
+    Parse = 1,
+    Quality = 2,
+    Store = 3,
+    Skip = 4        // Poll skipped while a fetch is pending, value is the count
+};
+
+// Fixed size record, stored little endian
+class Event
+{
+public:
+    quint8 kind;
+    quint8 category;
+    quint16 station;
+    quint32 value;
+    qint64 timeStamp;
+
+    static const int size = 16;
+
+    Event(quint8 k = Instant, quint8 c = Fetch, quint32 v = 0, qint64 t = 0) :
+        kind(k),
+        category(c),
+        station(0),
+        value(v),
+        timeStamp(t)
+    {}
+};
+
+inline const char *categoryName(quint8 category)
+{
+    switch (category) {
+    case Fetch: return "fetch";
+    case Parse: return "parse";
+    case Quality: return "quality";
+    case Store: return "store";
+    case Skip: return "skip";
+    default: return "unknown";
+    }
+}
+
+// Monotonic time in microseconds, comparable between processes of a host
+inline qint64 now()
+{
+#ifdef Q_OS_UNIX
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (qint64(ts.tv_sec) * 1000000) + (ts.tv_nsec / 1000);
+#else
+    return QDateTime::currentMSecsSinceEpoch() * 1000;
+#endif
+}
+
+inline void append(QByteArray &buffer, const Event &event)
+{
+    uchar record[Event::size];
+    record[0] = event.kind;
+    record[1] = event.category;
+    qToLittleEndian<quint16>(event.station, record + 2);
+    qToLittleEndian<quint32>(event.value, record + 4);
+    qToLittleEndian<qint64>(event.timeStamp, record + 8);
+    buffer.append(reinterpret_cast<const char *>(record), Event::size);
+}
+
+inline void appendStation(QByteArray &buffer, quint16 station, const QString &name)
+{
+    QByteArray utf8 = name.toUtf8();
+    Event event(Station, 0, utf8.size());
+    event.station = station;
+    append(buffer, event);
+    buffer.append(utf8);
+}
+
+// Decode record at offset, returns its full size or 0 if data is incomplete
+inline int read(const QByteArray &buffer, int offset, Event &event, QString *name = 0)
+{
+    if ((buffer.size() - offset) < Event::size) {
+        return 0;
+    }
+
+    const uchar *record = reinterpret_cast<const uchar *>(buffer.constData() + offset);
+    event.kind = record[0];
+    event.category = record[1];
+    event.station = qFromLittleEndian<quint16>(record + 2);
+    event.value = qFromLittleEndian<quint32>(record + 4);
+    event.timeStamp = qFromLittleEndian<qint64>(record + 8);
+
+    if (event.kind != Station) {
+        return Event::size;
+    }
+
+    if ((buffer.size() - offset - Event::size) < int(event.value)) {
+        return 0;
+    }
+    if (name) {
+        *name = QString::fromUtf8(buffer.constData() + offset + Event::size, event.value);
+    }
+    return Event::size + event.value;
+}
+
+}
+
+#endif // WEATHERLINKTRACE_H
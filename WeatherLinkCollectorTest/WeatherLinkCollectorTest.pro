@@ -0,0 +1,26 @@
+QT       += core network sql testlib
+
+QT       -= gui
+
+TARGET = tst_weatherlinkcollector
+CONFIG   += console testcase
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+# Same library as the QSQLITE driver, whose handle is used directly
+LIBS += -lsqlite3
+
+INCLUDEPATH += ../WeatherLinkCollector
+
+
+SOURCES += tst_weatherlinkcollector.cpp \
+    ../WeatherLinkCollector/weatherlinkcollector.cpp
+
+HEADERS += \
+    ../WeatherLinkCollector/weatherlinkcollector.h \
+    ../WeatherLinkCollector/weatherlinkschema.h \
+    ../WeatherLinkCollector/weatherlinktrace.h
+
+OTHER_FILES += \
+    summary.html
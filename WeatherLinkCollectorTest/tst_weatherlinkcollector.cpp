@@ -0,0 +1,241 @@
+#include "weatherlinkcollector.h"
+
+#include <QtTest>
+#include <QBuffer>
+#include <QTemporaryDir>
+
+#include <QtSql/QSqlDatabase>
+#include <QtSql/QSqlDriver>
+#include <QtSql/QSqlQuery>
+
+#include <stddef.h>
+
+#include <sqlite3.h>
+
+#ifdef __GLIBC__
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *pointer, size_t size);
+}
+
+// Allocations of the test thread while counting, operator new ends up in malloc
+static __thread bool counting = false;
+static __thread int allocations = 0;
+
+extern "C" void *malloc(size_t size)
+{
+    if (counting) {
+        allocations++;
+    }
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+    if (counting) {
+        allocations++;
+    }
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *pointer, size_t size)
+{
+    if (counting) {
+        allocations++;
+    }
+    return __libc_realloc(pointer, size);
+}
+#endif
+
+// Gives the test access to the steps of a poll cycle
+class TestCollector : public WeatherLinkCollector
+{
+public:
+    TestCollector(const QString &path) :
+        WeatherLinkCollector("station", QUrl("http://localhost/"), path)
+    {}
+
+    using WeatherLinkCollector::receive;
+    using WeatherLinkCollector::parse;
+    using WeatherLinkCollector::log;
+};
+
+class tst_WeatherLinkCollector : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void parseSummary();
+    void missingReading();
+    void steadyStateAllocations();
+
+private:
+    QTemporaryDir dir;
+    QByteArray page;
+    TestCollector *collector;
+};
+
+void tst_WeatherLinkCollector::initTestCase()
+{
+    QVERIFY(dir.isValid());
+
+    // Summary page as served by a WeatherLink station
+    QFile file(QFINDTESTDATA("summary.html"));
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    page = file.readAll();
+
+    collector = new TestCollector(dir.path() + "/weatherlink.sqlite");
+}
+
+void tst_WeatherLinkCollector::cleanupTestCase()
+{
+    delete collector;
+}
+
+void tst_WeatherLinkCollector::parseSummary()
+{
+    QBuffer buffer(&page);
+    QVERIFY(buffer.open(QIODevice::ReadOnly | QIODevice::Unbuffered));
+
+    collector->receive(&buffer);
+    QVERIFY(collector->parse());
+    collector->log();
+
+    // Read back stored sample
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", "check");
+        db.setDatabaseName(dir.path() + "/weatherlink.sqlite");
+        QVERIFY(db.open());
+
+        QSqlQuery sqlQuery(db);
+        QVERIFY(sqlQuery.exec("select currentOutsideTemperature, minOutsideTemperature, currentPressure, "
+                              "currentWindDirection, windGust, quality from station order by id desc limit 1"));
+        QVERIFY(sqlQuery.next());
+        QCOMPARE(sqlQuery.value(0).toDouble(), 21.3);
+        QCOMPARE(sqlQuery.value(1).toDouble(), 12.8);
+        QCOMPARE(sqlQuery.value(2).toDouble(), 1013.2);
+        QCOMPARE(sqlQuery.value(3).toInt(), 337);
+        QCOMPARE(sqlQuery.value(4).toDouble(), 29.0);
+        QCOMPARE(sqlQuery.value(5).toInt(), 0);
+    }
+    QSqlDatabase::removeDatabase("check");
+}
+
+void tst_WeatherLinkCollector::missingReading()
+{
+    // Dew point sensor out of order
+    QByteArray broken = page;
+    QVERIFY(broken.contains(">14.2 C<"));
+    broken.replace(">14.2 C<", ">---<");
+
+    QBuffer buffer(&broken);
+    QVERIFY(buffer.open(QIODevice::ReadOnly | QIODevice::Unbuffered));
+
+    collector->receive(&buffer);
+    QVERIFY(collector->parse());
+    collector->log();
+
+    // Stored as missing, not as a reading of 0
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", "check");
+        db.setDatabaseName(dir.path() + "/weatherlink.sqlite");
+        QVERIFY(db.open());
+
+        QSqlQuery sqlQuery(db);
+        QVERIFY(sqlQuery.exec("select currentDewPoint, currentOutsideTemperature, quality from station order by id desc limit 1"));
+        QVERIFY(sqlQuery.next());
+        QVERIFY(sqlQuery.value(0).isNull());
+        QCOMPARE(sqlQuery.value(1).toDouble(), 21.3);
+        QCOMPARE(sqlQuery.value(2).toInt(), 0);
+    }
+    QSqlDatabase::removeDatabase("check");
+}
+
+void tst_WeatherLinkCollector::steadyStateAllocations()
+{
+#ifndef __GLIBC__
+    QSKIP("Allocation counting needs glibc");
+#else
+    QBuffer buffer(&page);
+    QVERIFY(buffer.open(QIODevice::ReadOnly | QIODevice::Unbuffered));
+
+    // Warm up buffers, prepared statements and time zone data
+    for (int i = 0; i < 5; i++) {
+        buffer.seek(0);
+        collector->receive(&buffer);
+        QVERIFY(collector->parse());
+        collector->log();
+    }
+
+    // Same connection as the collector
+    QVariant handle = QSqlDatabase::database().driver()->handle();
+    QVERIFY(handle.isValid() && (qstrcmp(handle.typeName(), "sqlite3*") == 0));
+    sqlite3 *sqlite = *static_cast<sqlite3 **>(handle.data());
+
+    // Rows are removed between cycles, page splits of a growing table would allocate
+    const int cycles = 100;
+
+    // SQLite itself allocates cursors and records on every step when built without lookaside
+    QString insert = "insert into station values(NULL";
+    for (int i = 0; i < 30; i++) {
+        insert.append(", ?");
+    }
+    insert.append(")");
+    sqlite3_stmt *insertStatement = 0, *purgeStatement = 0;
+    QCOMPARE(sqlite3_prepare_v2(sqlite, insert.toUtf8().constData(), -1, &insertStatement, 0), SQLITE_OK);
+    QCOMPARE(sqlite3_prepare_v2(sqlite, "delete from station where timeStamp < ?", -1, &purgeStatement, 0), SQLITE_OK);
+
+    int sqliteAllocations = 0;
+    for (int i = 0; i < cycles + 5; i++) {
+        QCOMPARE(sqlite3_exec(sqlite, "delete from station", 0, 0, 0), SQLITE_OK);
+
+        allocations = 0;
+        counting = true;
+        sqlite3_bind_int64(insertStatement, 1, i);
+        for (int column = 2; column <= 30; column++) {
+            sqlite3_bind_double(insertStatement, column, column);
+        }
+        int inserted = sqlite3_step(insertStatement);
+        sqlite3_reset(insertStatement);
+        sqlite3_bind_int64(purgeStatement, 1, 0);
+        int purged = sqlite3_step(purgeStatement);
+        sqlite3_reset(purgeStatement);
+        counting = false;
+        QCOMPARE(inserted, SQLITE_DONE);
+        QCOMPARE(purged, SQLITE_DONE);
+
+        // First cycles warm up the same way
+        if (i >= 5) {
+            sqliteAllocations += allocations;
+        }
+    }
+    sqlite3_finalize(insertStatement);
+    sqlite3_finalize(purgeStatement);
+
+    // Read body, parse, quality control, insert and purge
+    int cycleAllocations = 0;
+    for (int i = 0; i < cycles; i++) {
+        buffer.seek(0);
+        QCOMPARE(sqlite3_exec(sqlite, "delete from station", 0, 0, 0), SQLITE_OK);
+
+        allocations = 0;
+        counting = true;
+        collector->receive(&buffer);
+        bool parsed = collector->parse();
+        collector->log();
+        counting = false;
+        cycleAllocations += allocations;
+        QVERIFY(parsed);
+    }
+
+    qDebug() << "SQLite allocations per cycle:" << (double(sqliteAllocations) / cycles);
+    QCOMPARE(cycleAllocations, sqliteAllocations);
+#endif
+}
+
+QTEST_GUILESS_MAIN(tst_WeatherLinkCollector)
+
+#include "tst_weatherlinkcollector.moc"
@@ -4,7 +4,7 @@
 #
 #-------------------------------------------------
 
-QT       += core sql
+QT       += core network sql
 
 QT       -= gui
 
@@ -14,12 +14,16 @@ CONFIG   -= app_bundle
 
 TEMPLATE = app
 
+INCLUDEPATH += ../WeatherLinkCollector
+
 
 SOURCES += main.cpp \
     weatherlinklauncher.cpp
 
 HEADERS += \
-    weatherlinklauncher.h
+    weatherlinklauncher.h \
+    ../WeatherLinkCollector/weatherlinkschema.h \
+    ../WeatherLinkCollector/weatherlinktrace.h
 
 target.path = /usr/bin
 INSTALLS += target
@@ -3,6 +3,25 @@
 
 #include "weatherlinklauncher.h"
 
+#ifdef Q_OS_UNIX
+#include <QSocketNotifier>
+
+#include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Signals are forwarded to the event loop through a socket pair
+static int signalFds[2];
+
+static void quitHandler(int)
+{
+    char c = 1;
+    ssize_t written = ::write(signalFds[0], &c, sizeof(c));
+    Q_UNUSED(written);
+}
+#endif
+
 int main(int argc, char *argv[])
 {
     QCoreApplication a(argc, argv);
@@ -11,19 +30,62 @@ int main(int argc, char *argv[])
     QString path(QDir::home().path());
     path.append(QDir::separator()).append("weatherlink.sqlite");
     path = QDir::toNativeSeparators(path);
+    quint32 waveSize = 25;
+    quint32 waveInterval = 250;
+    QString node;
+    QString store;
+    quint32 lease = 15;
+    QString trace;
 
     // Parse arguments
     QStringList args = a.arguments();
     for (int i = 0; i < args.count(); i++) {
         if (((args[i] == "--path") || (args[i] == "-p")) && (args.count() > ++i)) {
             path = args[i];
+        } else if (((args[i] == "--wave-size") || (args[i] == "-w")) && (args.count() > ++i)) {
+            waveSize = args[i].toUInt();
+        } else if (((args[i] == "--wave-interval") || (args[i] == "-i")) && (args.count() > ++i)) {
+            waveInterval = args[i].toUInt();
+        } else if (((args[i] == "--node") || (args[i] == "-n")) && (args.count() > ++i)) {
+            node = args[i];
+        } else if (((args[i] == "--store") || (args[i] == "-s")) && (args.count() > ++i)) {
+            store = args[i];
+        } else if (((args[i] == "--lease") || (args[i] == "-l")) && (args.count() > ++i)) {
+            lease = args[i].toUInt();
+        } else if (((args[i] == "--trace") || (args[i] == "-t")) && (args.count() > ++i)) {
+            trace = args[i];
         }
     }
 
     // Create and start Weather Link Launcher
-    WeatherLinkLauncher launcher(path);
+    WeatherLinkLauncher launcher(path, waveSize, waveInterval);
+    if (!node.isEmpty()) {
+        // Share stations with other launchers, metadata lives in the station db by default
+        launcher.setShard(node, store.isEmpty() ? path : store, lease);
+    }
+    if (!trace.isEmpty()) {
+        // Collect binary trace of all collectors
+        launcher.setTrace(trace);
+    }
     QObject::connect(&a, SIGNAL(aboutToQuit()),
                      &launcher, SLOT(aboutToQuit()));
+
+#ifdef Q_OS_UNIX
+    // Quit the event loop on SIGINT and SIGTERM so that aboutToQuit() gets called
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, signalFds) == 0) {
+        QSocketNotifier *notifier = new QSocketNotifier(signalFds[1], QSocketNotifier::Read, &a);
+        QObject::connect(notifier, SIGNAL(activated(int)),
+                         &a, SLOT(quit()));
+
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = quitHandler;
+        sigemptyset(&action.sa_mask);
+        action.sa_flags = SA_RESTART;
+        sigaction(SIGINT, &action, 0);
+        sigaction(SIGTERM, &action, 0);
+    }
+#endif
     launcher.start();
 
     return a.exec();
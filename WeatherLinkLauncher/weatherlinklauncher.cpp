@@ -1,26 +1,147 @@
 #include "weatherlinklauncher.h"
+#include "weatherlinkschema.h"
+#include "weatherlinktrace.h"
 
 #include <QtSql/QSqlDatabase>
 #include <QtSql/QSqlQuery>
 #include <QtSql/QSqlError>
 
+#include <QtNetwork/QLocalServer>
+#include <QtNetwork/QLocalSocket>
+
 #include <QDebug>
 #include <QProcess>
 #include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDateTime>
 #include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QMap>
+#include <QTimerEvent>
+
+#ifdef Q_OS_LINUX
+#include <signal.h>
+#include <sys/prctl.h>
+#include <unistd.h>
+#endif
+
+// Points of each launcher on the hash ring
+static const int virtualNodes = 64;
+
+// Hash shared by all launchers, unlike qHash which is seeded per process
+static quint32 ringHash(const QString &key)
+{
+    QByteArray digest = QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Md5);
+    return (quint32(quint8(digest[0])) << 24) | (quint32(quint8(digest[1])) << 16) |
+            (quint32(quint8(digest[2])) << 8) | quint32(quint8(digest[3]));
+}
+
+// Consistent hashing of stations over live launchers
+class WeatherLinkRing
+{
+public:
+    void setNodes(const QStringList &nodes)
+    {
+        points.clear();
+        foreach (const QString &node, nodes) {
+            for (int i = 0; i < virtualNodes; i++) {
+                points.insert(ringHash(QString("%1#%2").arg(node).arg(i)), node);
+            }
+        }
+    }
+
+    QString owner(const QString &station) const
+    {
+        if (points.isEmpty()) {
+            return QString();
+        }
+
+        // First launcher point clockwise from the station
+        QMap<quint32, QString>::const_iterator it = points.lowerBound(ringHash(station));
+        if (it == points.constEnd()) {
+            it = points.constBegin();
+        }
+        return it.value();
+    }
+
+private:
+    QMap<quint32, QString> points;
+};
+
+// Collector process that does not outlive its launcher
+class WeatherLinkProcess : public QProcess
+{
+public:
+    WeatherLinkProcess(QObject *parent) :
+        QProcess(parent)
+    {
+#ifdef Q_OS_LINUX
+        launcher = getpid();
+#endif
+    }
+
+protected:
+    void setupChildProcess()
+    {
+#ifdef Q_OS_LINUX
+        // Otherwise a crashed launcher leaves collectors running next to the ones of the new owner
+        prctl(PR_SET_PDEATHSIG, SIGTERM);
+        if (getppid() != launcher) {
+            _exit(1);
+        }
+#endif
+    }
+
+private:
+#ifdef Q_OS_LINUX
+    pid_t launcher;
+#endif
+};
 
 class WeatherLinkLauncherPrivate
 {
 public:
     QString dbPath;
     QList<QProcess *> processes;
+
+    quint32 waveSize, waveInterval;
+    int waveTimerId;
+    QMap<QString, QString> stations;
+    QHash<QString, QProcess *> running;
+    QStringList pending;
+    QHash<QString, qint64> queued;
+    int launched;
+    QElapsedTimer uptime;
+
+    QString node, storePath;
+    quint32 lease;
+    int heartbeatTimerId;
+    QElapsedTimer renewed;
+    QSqlDatabase store;
+    QStringList nodes;
+    WeatherLinkRing ring;
+
+    QLocalServer traceServer;
+    QFile traceFile;
+    QHash<QLocalSocket *, quint16> traceStations;
+    QHash<QLocalSocket *, QByteArray> traceBuffers;
+    quint16 traceStationCount;
 };
 
-WeatherLinkLauncher::WeatherLinkLauncher(const QString &dbPath, QObject *parent) :
+WeatherLinkLauncher::WeatherLinkLauncher(const QString &dbPath, quint32 waveSize, quint32 waveInterval, QObject *parent) :
     QObject(parent),
     d(new WeatherLinkLauncherPrivate)
 {
     d->dbPath = dbPath;
+    d->waveSize = qMax(waveSize, 1u);
+    d->waveInterval = waveInterval;
+    d->waveTimerId = 0;
+    d->launched = 0;
+    d->lease = 15;
+    d->heartbeatTimerId = 0;
+    d->traceStationCount = 0;
 }
 
 WeatherLinkLauncher::~WeatherLinkLauncher()
@@ -29,11 +150,50 @@ WeatherLinkLauncher::~WeatherLinkLauncher()
 }
 
 
+void WeatherLinkLauncher::setShard(const QString &node, const QString &storePath, quint32 lease)
+{
+    d->node = node;
+    d->storePath = storePath;
+    d->lease = qMax(lease, 3u);
+}
+
+bool WeatherLinkLauncher::setTrace(const QString &path)
+{
+    // Open trace file
+    d->traceFile.setFileName(path);
+    if (!d->traceFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qDebug() << "Trace error:" << qPrintable(d->traceFile.errorString());
+        return false;
+    }
+
+    QByteArray header(WeatherLinkTrace::magic, sizeof(WeatherLinkTrace::magic));
+    uchar version[4];
+    qToLittleEndian<quint32>(WeatherLinkTrace::version, version);
+    header.append(reinterpret_cast<const char *>(version), sizeof(version));
+    d->traceFile.write(header);
+
+    // Listen for collectors
+    QString server = QString("wl_trace_%1").arg(QCoreApplication::applicationPid());
+    QLocalServer::removeServer(server);
+    if (!d->traceServer.listen(server)) {
+        qDebug() << "Trace error:" << qPrintable(d->traceServer.errorString());
+        d->traceFile.close();
+        return false;
+    }
+    connect(&d->traceServer, SIGNAL(newConnection()),
+            this, SLOT(traceConnection()));
+
+    return true;
+}
+
 bool WeatherLinkLauncher::start()
 {
+    d->uptime.start();
+
     // Open db
     QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE");
     db.setDatabaseName(d->dbPath);
+    db.setConnectOptions("QSQLITE_BUSY_TIMEOUT=10000");
 
     // Open database
     if (!db.open()) {
@@ -43,7 +203,8 @@ bool WeatherLinkLauncher::start()
 
     // Dump all stations
     QSqlQuery sqlQuery(db);
-    if (!sqlQuery.exec(QString("select * from stations"))) {
+    sqlQuery.setForwardOnly(true);
+    if (!sqlQuery.exec(QString("select name, url from stations"))) {
         QSqlError error = sqlQuery.lastError();
         if (error.type() != QSqlError::NoError) {
             qDebug() << qPrintable(error.text());
@@ -51,44 +212,254 @@ bool WeatherLinkLauncher::start()
         }
     }
 
-    // Launch collectors
+    QStringList names;
     while (sqlQuery.next()) {
-        // Get station name
-        QString name = sqlQuery.value("name").toString();
-
-        // Get station url
-        QString url = sqlQuery.value("url").toString();
-
-        // Create process
-        QProcess *process = new QProcess(this);
-        connect(process, SIGNAL(error(QProcess::ProcessError)),
-                this, SLOT(error(QProcess::ProcessError)));
-        connect(process, SIGNAL(finished(int,QProcess::ExitStatus)),
-                this, SLOT(finished(int,QProcess::ExitStatus)));
-        connect(process, SIGNAL(started()),
-                this, SLOT(started()));
-        connect(process, SIGNAL(readyReadStandardError()),
-                this, SLOT(readyReadStandardError()));
-        connect(process, SIGNAL(readyReadStandardOutput()),
-                this, SLOT(readyReadStandardOutput()));
-
-        QString command = QString("%1/wl_collector -n %2 -u %3 -p %4")
-                .arg(QCoreApplication::applicationDirPath())
-                .arg(name)
-                .arg(url)
-                .arg(d->dbPath);
-        process->start(command);
-        d->processes += process;
+        // Get station name and url
+        QString name = sqlQuery.value(0).toString();
+        QString url = sqlQuery.value(1).toString();
+
+        d->stations.insert(name, url);
+        names += name;
     }
+    sqlQuery.finish();
+
+    // Create all station tables up front so collectors do not race on the schema
+    if (!WeatherLinkSchema::migrate(db, names)) {
+        return false;
+    }
+
+    // Without a node name, this launcher runs every station
+    if (d->node.isEmpty()) {
+        foreach (const QString &name, names) {
+            enqueue(name);
+        }
+        schedule();
+        return true;
+    }
+
+    // Open metadata store shared by all launchers
+    d->store = QSqlDatabase::addDatabase("QSQLITE", "store");
+    d->store.setDatabaseName(d->storePath);
+    d->store.setConnectOptions("QSQLITE_BUSY_TIMEOUT=10000");
+    if (!d->store.open()) {
+        qDebug() << qPrintable(d->store.lastError().text());
+        return false;
+    }
+
+    QSqlQuery storeQuery(d->store);
+    if (!storeQuery.exec("create table if not exists launchers"
+                         "(node text primary key,"
+                         "heartbeat integer,"
+                         "load integer)")) {
+        qDebug() << qPrintable(storeQuery.lastError().text());
+        return false;
+    }
+
+    // Join the ring and renew lease regularly
+    heartbeat();
+    d->heartbeatTimerId = startTimer(d->lease * 1000 / 3);
 
     return true;
 }
 
+void WeatherLinkLauncher::timerEvent(QTimerEvent *e)
+{
+    if (e->timerId() == d->heartbeatTimerId) {
+        heartbeat();
+        return;
+    }
+
+    // Next wave of collectors
+    launchWave();
+    if (d->pending.isEmpty()) {
+        killTimer(d->waveTimerId);
+        d->waveTimerId = 0;
+    }
+}
+
+void WeatherLinkLauncher::heartbeat()
+{
+    qint64 now = QDateTime::currentMSecsSinceEpoch() / 1000;
+
+    // Renew own lease and publish load
+    QSqlQuery sqlQuery(d->store);
+    sqlQuery.prepare("insert or replace into launchers values(?, ?, ?)");
+    sqlQuery.addBindValue(d->node);
+    sqlQuery.addBindValue(now);
+    sqlQuery.addBindValue(d->running.count());
+    if (!sqlQuery.exec()) {
+        qDebug() << qPrintable(sqlQuery.lastError().text());
+
+        // Lease would expire before next heartbeat, other launchers may take over our stations
+        if (!d->renewed.isValid() || (d->renewed.elapsed() >= (d->lease * 1000 * 2 / 3))) {
+            fence();
+        }
+        return;
+    }
+    d->renewed.start();
+
+    // Get launchers holding a valid lease
+    sqlQuery.prepare("select node from launchers where heartbeat >= ? order by node");
+    sqlQuery.addBindValue(now - d->lease);
+    if (!sqlQuery.exec()) {
+        qDebug() << qPrintable(sqlQuery.lastError().text());
+        return;
+    }
+
+    QStringList nodes;
+    while (sqlQuery.next()) {
+        nodes += sqlQuery.value(0).toString();
+    }
+    if (!nodes.contains(d->node)) {
+        nodes += d->node;
+    }
+
+    // Only stations whose owner changed are moved
+    if (nodes != d->nodes) {
+        qDebug() << "Launchers:" << qPrintable(nodes.join(" "));
+        d->nodes = nodes;
+        d->ring.setNodes(nodes);
+        rebalance();
+    }
+}
+
+void WeatherLinkLauncher::rebalance()
+{
+    int owned = 0;
+
+    QMap<QString, QString>::const_iterator it;
+    for (it = d->stations.constBegin(); it != d->stations.constEnd(); ++it) {
+        const QString &name = it.key();
+
+        if (d->ring.owner(name) == d->node) {
+            owned++;
+            if (!d->running.contains(name) && !d->pending.contains(name)) {
+                enqueue(name);
+            }
+        } else {
+            d->pending.removeAll(name);
+            d->queued.remove(name);
+
+            // Another launcher took over the station
+            QProcess *process = d->running.take(name);
+            if (process) {
+                qDebug() << "Release station:" << qPrintable(name);
+                process->terminate();
+            }
+        }
+    }
+
+    qDebug() << "Node" << qPrintable(d->node) << "owns" << owned << "of" << d->stations.count() << "stations";
+
+    schedule();
+}
+
+void WeatherLinkLauncher::fence()
+{
+    // Not part of the ring
+    if (d->nodes.isEmpty()) {
+        return;
+    }
+
+    qDebug() << "Lease of node" << qPrintable(d->node) << "lost, stop all collectors";
+
+    // Stations are collected by their new owners now
+    foreach (QProcess *process, d->running) {
+        process->terminate();
+    }
+    d->running.clear();
+    d->pending.clear();
+    d->queued.clear();
+    if (d->waveTimerId) {
+        killTimer(d->waveTimerId);
+        d->waveTimerId = 0;
+    }
+
+    // Join the ring again on next renewal
+    d->nodes.clear();
+}
+
+void WeatherLinkLauncher::enqueue(const QString &name)
+{
+    // Collectors report their time to first sample from here
+    d->pending += name;
+    d->queued.insert(name, QDateTime::currentMSecsSinceEpoch());
+}
+
+void WeatherLinkLauncher::schedule()
+{
+    if (d->pending.isEmpty() || d->waveTimerId) {
+        return;
+    }
+
+    // Launch collectors in waves
+    launchWave();
+    if (!d->pending.isEmpty()) {
+        d->waveTimerId = startTimer(d->waveInterval);
+    }
+}
+
+void WeatherLinkLauncher::launchWave()
+{
+    for (quint32 i = 0; (i < d->waveSize) && !d->pending.isEmpty(); i++) {
+        launch(d->pending.takeFirst());
+    }
+
+    if (d->pending.isEmpty()) {
+        qDebug() << "Launched" << d->launched << "collectors in" << d->uptime.elapsed() << "ms";
+    }
+}
+
+void WeatherLinkLauncher::launch(const QString &name)
+{
+    // Create process
+    QProcess *process = new WeatherLinkProcess(this);
+    connect(process, SIGNAL(error(QProcess::ProcessError)),
+            this, SLOT(error(QProcess::ProcessError)));
+    connect(process, SIGNAL(finished(int,QProcess::ExitStatus)),
+            this, SLOT(finished(int,QProcess::ExitStatus)));
+    connect(process, SIGNAL(started()),
+            this, SLOT(started()));
+
+    // Collector output goes straight to our own output
+    process->setProcessChannelMode(QProcess::ForwardedChannels);
+
+    QString command = QString("%1/wl_collector -n %2 -u %3 -p %4")
+            .arg(QCoreApplication::applicationDirPath())
+            .arg(name)
+            .arg(d->stations.value(name))
+            .arg(d->dbPath);
+    if (d->traceServer.isListening()) {
+        command.append(QString(" -t %1").arg(d->traceServer.serverName()));
+    }
+    if (d->queued.contains(name)) {
+        command.append(QString(" -s %1").arg(d->queued.take(name)));
+    }
+    process->setProperty("station", name);
+    process->start(command);
+    d->processes += process;
+    d->running.insert(name, process);
+    d->launched++;
+}
+
 void WeatherLinkLauncher::aboutToQuit()
 {
     fprintf(stderr, "About to quit!");
     QList<QProcess *> tmp;
 
+    // Give up stations right away instead of waiting for the lease to expire
+    if (d->store.isOpen()) {
+        QSqlQuery sqlQuery(d->store);
+        sqlQuery.prepare("delete from launchers where node = ?");
+        sqlQuery.addBindValue(d->node);
+        sqlQuery.exec();
+    }
+
+    // Keep trace of the last cycles
+    if (d->traceFile.isOpen()) {
+        d->traceFile.flush();
+    }
+
     foreach (QProcess * process, d->processes) {
         tmp += process;
     }
@@ -97,10 +468,16 @@ void WeatherLinkLauncher::aboutToQuit()
         process->terminate();
     }
 
-    while (d->processes.count());
+    // Event loop is gone, wait for collectors here
+    foreach (QProcess * process, tmp) {
+        if (!process->waitForFinished(5000)) {
+            process->kill();
+            process->waitForFinished(1000);
+        }
+    }
 }
 
-void WeatherLinkLauncher::error(QProcess::ProcessError)
+void WeatherLinkLauncher::error(QProcess::ProcessError error)
 {
     // Get associated process
     QProcess *process = qobject_cast<QProcess *>(sender());
@@ -110,6 +487,12 @@ void WeatherLinkLauncher::error(QProcess::ProcessError)
 
     // Remove process from the list of processes
     d->processes.removeAll(process);
+    release(process);
+
+    // No finished() follows a failed start
+    if (error == QProcess::FailedToStart) {
+        process->deleteLater();
+    }
 }
 
 void WeatherLinkLauncher::finished(int, QProcess::ExitStatus)
@@ -122,6 +505,19 @@ void WeatherLinkLauncher::finished(int, QProcess::ExitStatus)
 
     // Remove process from the list of processes
     d->processes.removeAll(process);
+    release(process);
+
+    // Collectors are relaunched on every membership change
+    process->deleteLater();
+}
+
+void WeatherLinkLauncher::release(QProcess *process)
+{
+    // Station may already run in a newer process
+    QString name = process->property("station").toString();
+    if (d->running.value(name) == process) {
+        d->running.remove(name);
+    }
 }
 
 void WeatherLinkLauncher::started()
@@ -133,20 +529,56 @@ void WeatherLinkLauncher::started()
     qDebug() << "Process started:" << qPrintable(process->program()) << qPrintable(process->arguments().join(" "));
 }
 
-void WeatherLinkLauncher::readyReadStandardError()
+void WeatherLinkLauncher::traceConnection()
 {
-    // Get associated process
-    QProcess *process = qobject_cast<QProcess *>(sender());
+    while (d->traceServer.hasPendingConnections()) {
+        QLocalSocket *socket = d->traceServer.nextPendingConnection();
+        connect(socket, SIGNAL(readyRead()),
+                this, SLOT(traceReadyRead()));
+        connect(socket, SIGNAL(disconnected()),
+                this, SLOT(traceDisconnected()));
+    }
+}
 
-    // Print to stderr
-    fprintf(stderr, qPrintable(QString(process->readAllStandardError())));
+void WeatherLinkLauncher::traceReadyRead()
+{
+    // Get associated socket
+    QLocalSocket *socket = qobject_cast<QLocalSocket *>(sender());
+
+    QByteArray &buffer = d->traceBuffers[socket];
+    buffer.append(socket->readAll());
+
+    // Tag events with the station of the collector
+    QByteArray output;
+    WeatherLinkTrace::Event event;
+    QString name;
+    int offset = 0, size;
+    while ((size = WeatherLinkTrace::read(buffer, offset, event, &name)) > 0) {
+        if (event.kind == WeatherLinkTrace::Station) {
+            quint16 station = ++d->traceStationCount;
+            d->traceStations.insert(socket, station);
+            WeatherLinkTrace::appendStation(output, station, name);
+        } else {
+            event.station = d->traceStations.value(socket);
+            WeatherLinkTrace::append(output, event);
+        }
+        offset += size;
+    }
+
+    // Keep incomplete record for next time
+    buffer.remove(0, offset);
+
+    // Keep the file usable even if the launcher dies
+    d->traceFile.write(output);
+    d->traceFile.flush();
 }
 
-void WeatherLinkLauncher::readyReadStandardOutput()
+void WeatherLinkLauncher::traceDisconnected()
 {
-    // Get associated process
-    QProcess *process = qobject_cast<QProcess *>(sender());
+    // Get associated socket
+    QLocalSocket *socket = qobject_cast<QLocalSocket *>(sender());
 
-    // Print to stderr
-    fprintf(stdout, qPrintable(QString(process->readAllStandardOutput())));
+    d->traceStations.remove(socket);
+    d->traceBuffers.remove(socket);
+    socket->deleteLater();
 }
@@ -9,22 +9,37 @@ class WeatherLinkLauncher : public QObject
 {
     Q_OBJECT
 public:
-    explicit WeatherLinkLauncher(const QString &dbPath, QObject *parent = 0);
+    explicit WeatherLinkLauncher(const QString &dbPath, quint32 waveSize = 25, quint32 waveInterval = 250, QObject *parent = 0);
     ~WeatherLinkLauncher();
 
+    void setShard(const QString &node, const QString &storePath, quint32 lease = 15);
+    bool setTrace(const QString &path);
     bool start();
 
 public slots:
     void aboutToQuit();
 
+protected:
+    void timerEvent(QTimerEvent *e);
+
 protected slots:
     void error(QProcess::ProcessError error);
     void finished(int exitCode, QProcess::ExitStatus exitStatus);
     void started();
-    void readyReadStandardError();
-    void readyReadStandardOutput();
+    void traceConnection();
+    void traceReadyRead();
+    void traceDisconnected();
 
 private:
+    void heartbeat();
+    void rebalance();
+    void fence();
+    void enqueue(const QString &name);
+    void schedule();
+    void launchWave();
+    void launch(const QString &name);
+    void release(QProcess *process);
+
     WeatherLinkLauncherPrivate *d;
 };
 
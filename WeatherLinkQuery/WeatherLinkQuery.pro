@@ -0,0 +1,21 @@
+QT       += core sql
+
+QT       -= gui
+
+TARGET = wl_query
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+INCLUDEPATH += ../WeatherLinkCollector
+
+SOURCES += main.cpp \
+    weatherlinkquery.cpp
+
+HEADERS += \
+    weatherlinkquery.h \
+    ../WeatherLinkCollector/weatherlinkschema.h
+
+target.path = /usr/bin
+INSTALLS += target
@@ -0,0 +1,78 @@
+#include "weatherlinkquery.h"
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDebug>
+#include <QFile>
+#include <QStringList>
+
+#include <stdio.h>
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QString name;
+    QString column = "currentOutsideTemperature";
+    QString path = "";
+    qint64 to = QDateTime::currentMSecsSinceEpoch() / 1000;
+    qint64 from = to - (7 * 24 * 3600);
+    quint32 points = 1000;
+    WeatherLinkQuery::Mode mode = WeatherLinkQuery::Lttb;
+    bool validOnly = false;
+    bool displayHelp = false;
+
+    // Parse arguments
+    QStringList args = a.arguments();
+    for (int i = 0; i < args.count(); i++) {
+        if (((args[i] == "--name") || (args[i] == "-n")) && (args.count() > ++i)) {
+            name = args[i];
+        } else if (((args[i] == "--column") || (args[i] == "-c")) && (args.count() > ++i)) {
+            column = args[i];
+        } else if (((args[i] == "--from") || (args[i] == "-f")) && (args.count() > ++i)) {
+            from = args[i].toLongLong();
+        } else if (((args[i] == "--to") || (args[i] == "-t")) && (args.count() > ++i)) {
+            to = args[i].toLongLong();
+        } else if (((args[i] == "--points") || (args[i] == "-s")) && (args.count() > ++i)) {
+            points = args[i].toUInt();
+        } else if (((args[i] == "--mode") || (args[i] == "-m")) && (args.count() > ++i)) {
+            if (args[i] == "minmax") {
+                mode = WeatherLinkQuery::MinMax;
+            } else if (args[i] != "lttb") {
+                displayHelp = true;
+            }
+        } else if ((args[i] == "--valid") || (args[i] == "-v")) {
+            validOnly = true;
+        } else if ((args[i] == "--help") || (args[i] == "-h")) {
+            displayHelp = true;
+        } else if (((args[i] == "--path") || (args[i] == "-p")) && (args.count() > ++i)) {
+            path = args[i];
+        }
+    }
+
+    // Test that we have all arguments
+    if (name.isEmpty() || displayHelp) {
+        QString help =
+                "WeatherLink Data Query\n"
+                "Options:\n"
+                " -n --name:   Name of meteo station\n"
+                " -c --column: Column to read (default currentOutsideTemperature)\n"
+                " -f --from:   Start of range in seconds since epoch (default 7 days ago)\n"
+                " -t --to:     End of range in seconds since epoch (default now)\n"
+                " -s --points: Maximum number of points to return (default 1000)\n"
+                " -m --mode:   Downsampling mode, lttb or minmax (default lttb)\n"
+                " -v --valid:  Skip samples whose reading was flagged by quality control\n"
+                " -p --path:   Path to database\n"
+                " -h --help:   Display current message\n";
+
+        qDebug() << qPrintable(help);
+        return 0;
+    }
+
+    // Stream result to stdout
+    QFile output;
+    output.open(stdout, QIODevice::WriteOnly);
+
+    WeatherLinkQuery query(path);
+    query.setValidOnly(validOnly);
+    return query.run(name, column, from, to, points, mode, &output) ? 0 : 1;
+}
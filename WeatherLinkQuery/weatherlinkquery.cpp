@@ -0,0 +1,392 @@
+#include "weatherlinkquery.h"
+#include "weatherlinkschema.h"
+
+#include <QtSql/QSqlDatabase>
+#include <QtSql/QSqlError>
+#include <QtSql/QSqlQuery>
+#include <QtSql/QSqlRecord>
+
+#include <QDebug>
+#include <QDir>
+#include <QTextStream>
+#include <QVector>
+#include <qnumeric.h>
+
+#include <math.h>
+
+class WeatherLinkPoint
+{
+public:
+    qint64 timeStamp;
+    double value;
+
+    WeatherLinkPoint() :
+        timeStamp(0),
+        value(0)
+    {}
+
+    WeatherLinkPoint(qint64 t, double v) :
+        timeStamp(t),
+        value(v)
+    {}
+};
+
+class WeatherLinkPointWriter
+{
+public:
+    WeatherLinkPointWriter(QIODevice *device) :
+        stream(device),
+        count(0)
+    {
+        // Enough digits for readings stored as doubles, without rounding artifacts
+        stream.setRealNumberNotation(QTextStream::SmartNotation);
+        stream.setRealNumberPrecision(10);
+    }
+
+    void begin(const QString &station, const QString &column)
+    {
+        stream << "{\"station\":\"" << station << "\",\"column\":\"" << column << "\",\"points\":[";
+    }
+
+    void write(const WeatherLinkPoint &point)
+    {
+        if (count++) {
+            stream << ',';
+        }
+        stream << '[' << point.timeStamp << ',';
+        if (qIsFinite(point.value)) {
+            stream << point.value;
+        } else {
+            // nan and inf are not valid JSON
+            stream << "null";
+        }
+        stream << ']';
+    }
+
+    void end()
+    {
+        stream << "]}\n";
+        stream.flush();
+    }
+
+    QTextStream stream;
+    quint32 count;
+};
+
+// Largest-Triangle-Three-Buckets, fed in time order and keeping at most two buckets in memory
+class WeatherLinkLttb
+{
+public:
+    WeatherLinkLttb(quint32 totalPoints, quint32 points, WeatherLinkPointWriter *pointWriter) :
+        writer(pointWriter),
+        total(totalPoints),
+        buckets(points - 2),
+        every(double(totalPoints - 2) / (points - 2)),
+        index(0),
+        bucket(0)
+    {}
+
+    void add(const WeatherLinkPoint &point)
+    {
+        if (index == 0) {
+            // First point is always kept
+            anchor = point;
+            writer->write(point);
+        } else if (index == total - 1) {
+            // Flush remaining buckets, last point is always kept
+            if (!next.isEmpty()) {
+                select(current, average(next));
+                select(next, point);
+            } else if (!current.isEmpty()) {
+                select(current, point);
+            }
+            writer->write(point);
+        } else {
+            // Point belongs to the bucket after next, current one can be reduced
+            if (index >= end(bucket + 1)) {
+                select(current, average(next));
+                qSwap(current, next);
+                next.clear();
+                bucket++;
+            }
+
+            if (index < end(bucket)) {
+                current += point;
+            } else {
+                next += point;
+            }
+        }
+
+        index++;
+    }
+
+private:
+    quint32 end(quint32 b) const
+    {
+        // Last bucket always ends right before the last point
+        if (b + 1 >= buckets) {
+            return total - 1;
+        }
+        return quint32((b + 1) * every) + 1;
+    }
+
+    static WeatherLinkPoint average(const QVector<WeatherLinkPoint> &points)
+    {
+        double t = 0, v = 0;
+        foreach (const WeatherLinkPoint &point, points) {
+            t += point.timeStamp;
+            v += point.value;
+        }
+        return WeatherLinkPoint(qint64(t / points.count()), v / points.count());
+    }
+
+    void select(const QVector<WeatherLinkPoint> &points, const WeatherLinkPoint &c)
+    {
+        // Keep the point forming the largest triangle with the previous pick and the next average
+        double maxArea = -1;
+        int selected = 0;
+        for (int i = 0; i < points.count(); i++) {
+            const WeatherLinkPoint &b = points[i];
+            double area = fabs((double(anchor.timeStamp) - c.timeStamp) * (b.value - anchor.value) -
+                               (double(anchor.timeStamp) - b.timeStamp) * (c.value - anchor.value));
+            if (area > maxArea) {
+                maxArea = area;
+                selected = i;
+            }
+        }
+
+        anchor = points[selected];
+        writer->write(anchor);
+    }
+
+    WeatherLinkPointWriter *writer;
+    quint32 total, buckets;
+    double every;
+    quint32 index, bucket;
+    WeatherLinkPoint anchor;
+    QVector<WeatherLinkPoint> current, next;
+};
+
+// Keep minimum and maximum of each bucket, in time order
+class WeatherLinkMinMax
+{
+public:
+    WeatherLinkMinMax(quint32 totalPoints, quint32 bucketCount, WeatherLinkPointWriter *pointWriter) :
+        writer(pointWriter),
+        total(totalPoints),
+        buckets(bucketCount),
+        every(double(totalPoints) / bucketCount),
+        index(0),
+        bucket(0),
+        empty(true)
+    {}
+
+    void add(const WeatherLinkPoint &point)
+    {
+        while (index >= end(bucket)) {
+            flush();
+            bucket++;
+        }
+
+        if (empty || (point.value < min.value)) {
+            min = point;
+            minIndex = index;
+        }
+        if (empty || (point.value > max.value)) {
+            max = point;
+            maxIndex = index;
+        }
+        empty = false;
+
+        index++;
+    }
+
+    void flush()
+    {
+        if (empty) {
+            return;
+        }
+
+        if (minIndex == maxIndex) {
+            writer->write(min);
+        } else if (minIndex < maxIndex) {
+            writer->write(min);
+            writer->write(max);
+        } else {
+            writer->write(max);
+            writer->write(min);
+        }
+        empty = true;
+    }
+
+private:
+    quint32 end(quint32 b) const
+    {
+        if (b + 1 >= buckets) {
+            return total;
+        }
+        return quint32((b + 1) * every);
+    }
+
+    WeatherLinkPointWriter *writer;
+    quint32 total, buckets;
+    double every;
+    quint32 index, bucket;
+    bool empty;
+    WeatherLinkPoint min, max;
+    quint32 minIndex, maxIndex;
+};
+
+class WeatherLinkQueryPrivate
+{
+public:
+    WeatherLinkQueryPrivate(const QString &where) :
+        path(where),
+        db(QSqlDatabase::addDatabase("QSQLITE")),
+        validOnly(false)
+    {
+        // Compute path if not provided
+        if (path.isEmpty()) {
+            path = QString(QDir::home().path());
+            path.append(QDir::separator()).append("weatherlink.sqlite");
+            path = QDir::toNativeSeparators(path);
+        }
+
+        // Set database name
+        db.setDatabaseName(path);
+        db.setConnectOptions("QSQLITE_BUSY_TIMEOUT=10000");
+
+        // Open database
+        if (!db.open()) {
+            qDebug() << qPrintable(db.lastError().text());
+        }
+    }
+
+    ~WeatherLinkQueryPrivate()
+    {
+        db.close();
+    }
+
+    QString path;
+    QSqlDatabase db;
+    bool validOnly;
+};
+
+
+
+WeatherLinkQuery::WeatherLinkQuery(const QString &path, QObject *parent) :
+    QObject(parent),
+    d(new WeatherLinkQueryPrivate(path))
+{
+}
+
+WeatherLinkQuery::~WeatherLinkQuery()
+{
+    delete d;
+}
+
+
+void WeatherLinkQuery::setValidOnly(bool validOnly)
+{
+    d->validOnly = validOnly;
+}
+
+
+bool WeatherLinkQuery::run(const QString &station, const QString &column, qint64 from, qint64 to, quint32 points, Mode mode, QIODevice *output)
+{
+    if (!d->db.isOpen()) {
+        return false;
+    }
+
+    // Station and column end up in the statement, only accept known ones
+    if (!d->db.tables().contains(station)) {
+        qDebug() << "Unknown station:" << qPrintable(station);
+        return false;
+    }
+    QSqlRecord record = d->db.record(station);
+    if (!record.contains(column)) {
+        qDebug() << "Unknown column:" << qPrintable(column);
+        return false;
+    }
+
+    // Missing readings are not points
+    QString filter = QString(" and %1 is not null").arg(column);
+
+    // Skip samples whose reading of that column was flagged by quality control
+    if (d->validOnly) {
+        if (!record.contains("quality")) {
+            qDebug() << "No quality flags for station:" << qPrintable(station);
+            return false;
+        }
+        int field = WeatherLinkSchema::qualityField(column);
+        if (field < 0) {
+            qDebug() << "No quality flags for column:" << qPrintable(column);
+            return false;
+        }
+        filter.append(QString(" and ((quality >> %1) & %2) = 0").arg(field).arg(WeatherLinkSchema::qualityMask));
+    }
+
+    // Need at least the first and last points plus one bucket
+    points = qMax(points, 3u);
+
+    // Count and read in the same transaction so that both see the same rows
+    if (!d->db.transaction()) {
+        qDebug() << qPrintable(d->db.lastError().text());
+        return false;
+    }
+
+    QSqlQuery sqlQuery(d->db);
+    sqlQuery.setForwardOnly(true);
+    sqlQuery.prepare(QString("select count(*) from %1 where timeStamp >= ? and timeStamp <= ?%2")
+                     .arg(station)
+                     .arg(filter));
+    sqlQuery.addBindValue(from);
+    sqlQuery.addBindValue(to);
+    if (!sqlQuery.exec()) {
+        qDebug() << qPrintable(sqlQuery.lastError().text());
+        d->db.rollback();
+        return false;
+    }
+    quint32 total = sqlQuery.next() ? sqlQuery.value(0).toUInt() : 0;
+    sqlQuery.finish();
+
+    sqlQuery.prepare(QString("select timeStamp, %1 from %2 where timeStamp >= ? and timeStamp <= ?%3 order by timeStamp")
+                     .arg(column)
+                     .arg(station)
+                     .arg(filter));
+    sqlQuery.addBindValue(from);
+    sqlQuery.addBindValue(to);
+    if (!sqlQuery.exec()) {
+        qDebug() << qPrintable(sqlQuery.lastError().text());
+        d->db.rollback();
+        return false;
+    }
+
+    // Stream points as soon as they are selected
+    WeatherLinkPointWriter writer(output);
+    writer.begin(station, column);
+
+    if (total <= points) {
+        // Raw samples already fit the requested resolution
+        while (sqlQuery.next()) {
+            writer.write(WeatherLinkPoint(sqlQuery.value(0).toLongLong(), sqlQuery.value(1).toDouble()));
+        }
+    } else if (mode == MinMax) {
+        WeatherLinkMinMax minMax(total, points / 2, &writer);
+        while (sqlQuery.next()) {
+            minMax.add(WeatherLinkPoint(sqlQuery.value(0).toLongLong(), sqlQuery.value(1).toDouble()));
+        }
+        minMax.flush();
+    } else {
+        WeatherLinkLttb lttb(total, points, &writer);
+        while (sqlQuery.next()) {
+            lttb.add(WeatherLinkPoint(sqlQuery.value(0).toLongLong(), sqlQuery.value(1).toDouble()));
+        }
+    }
+
+    writer.end();
+    sqlQuery.finish();
+    d->db.commit();
+
+    return true;
+}
@@ -0,0 +1,30 @@
+#ifndef WEATHERLINKQUERY_H
+#define WEATHERLINKQUERY_H
+
+#include <QObject>
+#include <QIODevice>
+
+class WeatherLinkQueryPrivate;
+
+class WeatherLinkQuery : public QObject
+{
+    Q_OBJECT
+public:
+    enum Mode {
+        Lttb,
+        MinMax
+    };
+
+    explicit WeatherLinkQuery(const QString &path = "", QObject *parent = 0);
+    ~WeatherLinkQuery();
+
+    void setValidOnly(bool validOnly);
+
+    bool run(const QString &station, const QString &column, qint64 from, qint64 to, quint32 points, Mode mode, QIODevice *output);
+
+private:
+    WeatherLinkQueryPrivate *d;
+
+};
+
+#endif // WEATHERLINKQUERY_H
@@ -0,0 +1,20 @@
+QT       += core
+
+QT       -= gui
+
+TARGET = wl_trace
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+INCLUDEPATH += ../WeatherLinkCollector
+
+
+SOURCES += main.cpp
+
+HEADERS += \
+    ../WeatherLinkCollector/weatherlinktrace.h
+
+target.path = /usr/bin
+INSTALLS += target
@@ -0,0 +1,122 @@
+#include "weatherlinktrace.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QFile>
+#include <QStringList>
+#include <QTextStream>
+
+#include <stdio.h>
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QString input;
+    QString output;
+    bool displayHelp = false;
+
+    // Parse arguments
+    QStringList args = a.arguments();
+    for (int i = 0; i < args.count(); i++) {
+        if (((args[i] == "--input") || (args[i] == "-i")) && (args.count() > ++i)) {
+            input = args[i];
+        } else if (((args[i] == "--output") || (args[i] == "-o")) && (args.count() > ++i)) {
+            output = args[i];
+        } else if ((args[i] == "--help") || (args[i] == "-h")) {
+            displayHelp = true;
+        }
+    }
+
+    // Test that we have all arguments
+    if (input.isEmpty() || displayHelp) {
+        QString help =
+                "WeatherLink Trace Converter\n"
+                "Converts a launcher trace to Chrome trace JSON\n"
+                "Options:\n"
+                " -i --input:  Trace file written by the launcher\n"
+                " -o --output: JSON file (default stdout)\n"
+                " -h --help:   Display current message\n";
+
+        qDebug() << qPrintable(help);
+        return 0;
+    }
+
+    // Read trace
+    QFile file(input);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qDebug() << qPrintable(file.errorString());
+        return 1;
+    }
+    QByteArray trace = file.readAll();
+
+    if ((trace.size() < WeatherLinkTrace::headerSize) ||
+            !trace.startsWith(QByteArray(WeatherLinkTrace::magic, sizeof(WeatherLinkTrace::magic))) ||
+            (qFromLittleEndian<quint32>(reinterpret_cast<const uchar *>(trace.constData()) + 4) != WeatherLinkTrace::version)) {
+        qDebug() << "Not a trace file:" << qPrintable(input);
+        return 1;
+    }
+
+    // Open output
+    QFile json;
+    if (output.isEmpty()) {
+        json.open(stdout, QIODevice::WriteOnly);
+    } else {
+        json.setFileName(output);
+        if (!json.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            qDebug() << qPrintable(json.errorString());
+            return 1;
+        }
+    }
+    QTextStream stream(&json);
+
+    // Records are in arrival order, a cycle that ended late may have started first
+    WeatherLinkTrace::Event event;
+    QString name;
+    qint64 origin = -1;
+    int offset = WeatherLinkTrace::headerSize, size, count = 0;
+    while ((size = WeatherLinkTrace::read(trace, offset, event)) > 0) {
+        offset += size;
+        if ((event.kind != WeatherLinkTrace::Station) && ((origin < 0) || (event.timeStamp < origin))) {
+            origin = event.timeStamp;
+        }
+    }
+
+    // Convert records, times relative to the earliest event
+    stream << "{\"traceEvents\":[";
+    offset = WeatherLinkTrace::headerSize;
+    while ((size = WeatherLinkTrace::read(trace, offset, event, &name)) > 0) {
+        offset += size;
+
+        if (count++) {
+            stream << ",";
+        }
+        stream << "\n";
+
+        if (event.kind == WeatherLinkTrace::Station) {
+            name.replace("\\", "\\\\").replace("\"", "\\\"");
+            stream << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << event.station
+                   << ",\"args\":{\"name\":\"" << name << "\"}}";
+            continue;
+        }
+
+        const char *phase = (event.kind == WeatherLinkTrace::Begin) ? "B" : (event.kind == WeatherLinkTrace::End) ? "E" : "i";
+        stream << "{\"name\":\"" << WeatherLinkTrace::categoryName(event.category) << "\",\"cat\":\"collector\""
+               << ",\"ph\":\"" << phase << "\",\"ts\":" << (event.timeStamp - origin)
+               << ",\"pid\":1,\"tid\":" << event.station;
+        if (event.kind == WeatherLinkTrace::Instant) {
+            stream << ",\"s\":\"t\"";
+        }
+        if (event.kind != WeatherLinkTrace::Begin) {
+            stream << ",\"args\":{\"value\":" << event.value << "}";
+        }
+        stream << "}";
+    }
+    stream << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    stream.flush();
+
+    if (offset != trace.size()) {
+        qDebug() << "Trace truncated at offset" << offset;
+    }
+
+    return 0;
+}